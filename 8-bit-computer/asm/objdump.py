@@ -0,0 +1,86 @@
+#!/usr/bin/env python2
+
+# objdump.py prog.obj
+#
+# Print the header, symbols and relocations of an object file written by
+# asm.py -o, and disassemble its text with references shown by name.
+
+import sys
+
+import objfile
+
+alu = ["add", "sub", "inc", "dec", "and", "or", "xor", "adc"]
+jumps = ["jmp", "jz", "jnz", "jc", "jnc"]
+regs = "ABCDEFGM"
+simple = {0x00: "nop", 0x01: "call", 0x02: "ret", 0x03: "out", 0x04: "in", 0x05: "hlt", 0x06: "cmp"}
+
+
+def decode(op):
+    """Mnemonic and operand count of the instruction starting with op"""
+    if op in simple:
+        return simple[op], 1 if op in (0x01, 0x03, 0x04) else 0
+    if op & 0xf8 == 0x10:
+        return "ldi %s" % regs[op & 7], 1
+    if op & 0xf8 == 0x18 and op & 7 < len(jumps):
+        return jumps[op & 7], 1
+    if op & 0xf8 == 0x20:
+        return "push %s" % regs[op & 7], 0
+    if op & 0xf8 == 0x28:
+        return "pop %s" % regs[op & 7], 0
+    if op & 0xc7 == 0x40:
+        return alu[(op >> 3) & 7], 0
+    if op & 0xc0 == 0x80:
+        dst, src = (op >> 3) & 7, op & 7
+        if op == 0x87:
+            return "lda", 1
+        if op == 0xb8:
+            return "sta", 1
+        return "mov %s %s" % (regs[dst], regs[src]), 1 if 7 in (dst, src) else 0
+    return "db 0x%02x" % op, 0
+
+
+try:
+    obj = objfile.Object(sys.argv[1])
+    text, data = obj.text(), obj.data()
+    symbols = obj.symbols()
+    relocs = dict(obj.relocs())
+except (IOError, objfile.ObjectError) as e:
+    sys.stderr.write("objdump.py: %s\n" % e)
+    sys.exit(1)
+
+print("%s: version %d" % (sys.argv[1], obj.version))
+print("  text     %3d bytes at 0x00" % len(text))
+print("  data     %3d bytes at 0x%02x" % (len(data), len(text)))
+print("  symbols  %3d" % len(symbols))
+print("  relocs   %3d" % len(relocs))
+
+print("\nSymbols:")
+for name, address, section in symbols:
+    print("  %02x  %-4s  %s" % (address, "text" if section == objfile.TEXT else "data", name))
+
+print("\nRelocations:")
+for offset in sorted(relocs):
+    print("  %02x  %s" % (offset, symbols[relocs[offset]][0]))
+
+print("\nText:")
+labels = dict((a, n) for n, a, s in symbols if s == objfile.TEXT)
+i = 0
+while i < len(text):
+    if i in labels:
+        print("%s:" % labels[i])
+    name, operands = decode(text[i])
+    raw = text[i:i + 1 + operands]
+    args = []
+    for j in range(i + 1, i + 1 + operands):
+        if j in relocs:
+            args.append("%" + symbols[relocs[j]][0])
+        elif j < len(text):
+            args.append(str(text[j]))
+    print("  %02x  %-6s  %s" % (i, " ".join("%02x" % b for b in raw), " ".join([name] + args)))
+    i += 1 + operands
+
+print("\nData:")
+names = dict((a, n) for n, a, s in symbols if s == objfile.DATA)
+for i, b in enumerate(data):
+    address = len(text) + i
+    print("  %02x  %02x      %s" % (address, b, names.get(address, "")))
@@ -0,0 +1,137 @@
+# Object files written by asm.py -o, read by objdump.py and objload.py
+#
+# All fields are little-endian. The file starts with a 48 byte header:
+#
+#   magic     4s    "S8OB"
+#   version   H     1
+#   flags     H     0
+#   text      I I   offset, size in bytes
+#   data      I I   offset, size in bytes
+#   symbols   I I   offset, count
+#   relocs    I I   offset, count
+#   strings   I I   offset, size in bytes
+#
+# text holds the encoded instructions, loaded at address 0, with 0 in
+# place of every %name operand. data holds the initial value of each data
+# byte, loaded right after text. Sections start on 4 byte boundaries, so
+# the file can be memory mapped and read in place.
+#
+# A symbol is 8 bytes: name (I, offset of a NUL terminated string in
+# strings), address (B), section (B, 0 for a text label, 1 for data) and
+# 2 bytes of padding. A relocation is 4 bytes: the text offset of an
+# operand (H) and the index of the symbol whose address goes there (H).
+
+import mmap
+import struct
+
+MAGIC = b"S8OB"
+VERSION = 1
+MEM_SIZE = 256
+
+HEADER = struct.Struct("<4sHH10I")
+SYMBOL = struct.Struct("<IBBH")
+RELOC = struct.Struct("<HH")
+
+TEXT, DATA = 0, 1
+
+
+class ObjectError(Exception):
+    pass
+
+
+def align(n):
+    return (n + 3) & ~3
+
+
+def write(path, text, data, symbols, relocs):
+    """Write an object file
+
+    text and data are lists of byte values, symbols a list of
+    (name, address, section) and relocs a list of (offset, symbol index).
+    """
+    strings = bytearray()
+    symbol_table = bytearray()
+    for name, address, section in symbols:
+        symbol_table += SYMBOL.pack(len(strings), address, section, 0)
+        strings += name.encode("ascii") + b"\0"
+
+    reloc_table = bytearray()
+    for offset, index in relocs:
+        reloc_table += RELOC.pack(offset, index)
+
+    sections = [bytearray(text), bytearray(data), symbol_table, reloc_table, strings]
+    counts = [len(text), len(data), len(symbols), len(relocs), len(strings)]
+    fields = []
+    body = bytearray()
+    offset = HEADER.size
+    for section, count in zip(sections, counts):
+        fields += [offset, count]
+        body += section + b"\0" * (align(len(section)) - len(section))
+        offset += align(len(section))
+
+    with open(path, "wb") as f:
+        f.write(HEADER.pack(MAGIC, VERSION, 0, *fields))
+        f.write(body)
+
+
+class Object(object):
+    """An object file mapped into memory"""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        if len(self.map) < HEADER.size:
+            raise ObjectError("%s: not an object file" % path)
+        fields = HEADER.unpack_from(self.map, 0)
+        if fields[0] != MAGIC:
+            raise ObjectError("%s: not an object file" % path)
+        if fields[1] != VERSION:
+            raise ObjectError("%s: unsupported version %d" % (path, fields[1]))
+        self.version = fields[1]
+        (self.text_offset, self.text_size,
+         self.data_offset, self.data_size,
+         self.symbol_offset, self.symbol_count,
+         self.reloc_offset, self.reloc_count,
+         self.string_offset, self.string_size) = fields[3:]
+        if self.string_offset + self.string_size > len(self.map):
+            raise ObjectError("%s: truncated" % path)
+        if self.text_size + self.data_size > MEM_SIZE:
+            raise ObjectError("%s: does not fit in %d bytes" % (path, MEM_SIZE))
+
+    def text(self):
+        return bytearray(self.map[self.text_offset:self.text_offset + self.text_size])
+
+    def data(self):
+        return bytearray(self.map[self.data_offset:self.data_offset + self.data_size])
+
+    def name(self, offset):
+        start = self.string_offset + offset
+        end = self.map.find(b"\0", start)
+        return self.map[start:end].decode("ascii")
+
+    def symbols(self):
+        """(name, address, section) of every symbol"""
+        result = []
+        for i in range(self.symbol_count):
+            name, address, section, _ = SYMBOL.unpack_from(self.map, self.symbol_offset + i * SYMBOL.size)
+            result.append((self.name(name), address, section))
+        return result
+
+    def relocs(self):
+        """(text offset, symbol index) of every relocation"""
+        return [RELOC.unpack_from(self.map, self.reloc_offset + i * RELOC.size)
+                for i in range(self.reloc_count)]
+
+    def image(self):
+        """The 256 bytes of memory the program starts with"""
+        mem = self.text() + self.data()
+        mem += bytearray(MEM_SIZE - len(mem))
+        symbols = self.symbols()
+        for offset, index in self.relocs():
+            if offset >= self.text_size or index >= len(symbols):
+                raise ObjectError("bad relocation at %02x" % offset)
+            mem[offset] = symbols[index][1]
+        return mem
+
+    def close(self):
+        self.map.close()
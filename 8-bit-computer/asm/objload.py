@@ -0,0 +1,20 @@
+#!/usr/bin/env python2
+
+# objload.py prog.obj > memory.list
+#
+# Lay out an object file written by asm.py -o in memory and resolve its
+# references, giving the same memory.list as assembling the source.
+
+import sys
+
+import objfile
+
+try:
+    obj = objfile.Object(sys.argv[1])
+    mem = obj.image()
+    obj.close()
+except (IOError, objfile.ObjectError) as e:
+    sys.stderr.write("objload.py: %s\n" % e)
+    sys.exit(1)
+
+print(' '.join(['%02x' % b for b in mem]))
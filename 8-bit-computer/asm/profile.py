@@ -0,0 +1,85 @@
+#!/usr/bin/env python2
+
+# profile.py prog.map [profile.txt]
+#
+# Flat profile of a simulated run. prog.map is the symbol map written by
+# asm.py -m and profile.txt the histogram written by the testbench when run
+# with +profile, one "address fetches cycles" line per executed address.
+# Prints the cycles and instructions spent under each label, counting an
+# address under the closest label before it, then the same per source line.
+
+import signal
+import sys
+
+# Stop quietly when the reader does, as with 'profile.py ... | head -1'
+signal.signal(signal.SIGPIPE, signal.SIG_DFL)
+
+
+def read_map(path):
+    source, labels, lines = None, [], {}
+    with open(path) as f:
+        for l in f:
+            kw = l.split(None, 3)
+            if kw[0] == "file":
+                source = l.split(None, 1)[1].strip()
+            elif kw[0] == "label":
+                labels.append((int(kw[1], 16), kw[2]))
+            elif kw[0] == "line":
+                lines[int(kw[1], 16)] = (int(kw[2]), kw[3].strip() if len(kw) > 3 else "")
+    return source, sorted(labels), lines
+
+
+def read_profile(path):
+    counts = {}
+    with open(path) as f:
+        for l in f:
+            address, fetches, cycles = l.split()
+            counts[int(address, 16)] = (int(fetches), int(cycles))
+    return counts
+
+
+def label_of(labels, address):
+    name = "(start)"
+    for a, n in labels:
+        if a > address:
+            break
+        name = n
+    return name
+
+
+def percent(cycles, total):
+    return 100.0 * cycles / total if total else 0.0
+
+
+try:
+    source, labels, lines = read_map(sys.argv[1])
+    counts = read_profile(sys.argv[2] if len(sys.argv) > 2 else "profile.txt")
+except (IOError, IndexError, ValueError) as e:
+    sys.stderr.write("profile.py: %s\n" % e)
+    sys.exit(1)
+
+total_cycles = sum(c for _, c in counts.values())
+total_fetches = sum(f for f, _ in counts.values())
+print("%s: %d cycles, %d instructions" % (source, total_cycles, total_fetches))
+
+per_label = {}
+order = []
+for address in sorted(counts):
+    name = label_of(labels, address)
+    if name not in per_label:
+        per_label[name] = [0, 0]
+        order.append(name)
+    per_label[name][0] += counts[address][1]
+    per_label[name][1] += counts[address][0]
+
+print("\n  %8s  %6s  %12s  %s" % ("cycles", "%", "instructions", "label"))
+for name in sorted(order, key=lambda n: (-per_label[n][0], order.index(n))):
+    cycles, fetches = per_label[name]
+    print("  %8d  %5.1f%%  %12d  %s" % (cycles, percent(cycles, total_cycles), fetches, name))
+
+print("\n  %8s  %6s  %12s  %5s  %-4s  %s" % ("cycles", "%", "instructions", "line", "addr", "source"))
+for address in sorted(counts, key=lambda a: (-counts[a][1], a)):
+    fetches, cycles = counts[address]
+    lineno, text = lines.get(address, (0, "(not an instruction)"))
+    print("  %8d  %5.1f%%  %12d  %5s  %02x    %s" % (cycles, percent(cycles, total_cycles), fetches,
+                                                  lineno or "-", address, text))
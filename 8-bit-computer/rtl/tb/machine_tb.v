@@ -23,14 +23,90 @@ module machine_tb;
   );
 
 
+  // ==========================
+  // Options
+  // ==========================
+
+  // +memory=<file>      memory image to load (memory.list)
+  // +vcd=<file>         waveform dump (machine.vcd), +no_vcd to skip it
+  // +max_cycles=<n>     stop a program that has not halted after n cycles
+  // +profile=<file>     write a profile at halt (+profile for profile.txt)
+  reg [8*256-1:0] memory_path;
+  reg [8*256-1:0] vcd_path;
+  reg [8*256-1:0] profile_path;
+  integer max_cycles;
+
+
   // ==========================
   // Tests and monitoring
   // ==========================
 
+  integer cycles = 0;
+  always @ (posedge m_machine.m_cpu.cycle_clk) begin
+    cycles = cycles + 1;
+    if (max_cycles > 0 && cycles >= max_cycles) begin
+      $display("============================================");
+      $display("CPU stopped after %0d cycles without halting.", cycles);
+      $finish;
+    end
+  end
+
+  // One FETCH_INST state per instruction
+  integer instructions = 0;
+  always @ (posedge m_machine.m_cpu.c_ii) begin
+    instructions = instructions + 1;
+  end
+
+  // Profile: instructions fetched and cycles spent at each address. The
+  // address is in the memory address register when the opcode is fetched,
+  // and an instruction is charged every cycle until the next fetch (the
+  // first one also gets the cycles before it).
+  integer fetches [0:255];
+  integer pc_cycles [0:255];
+  integer fetch_pc = -1;
+  integer fetch_cycles = 0;
+  integer i;
+  always @ (posedge m_machine.m_cpu.c_ii) begin
+    if (fetch_pc >= 0) begin
+      pc_cycles[fetch_pc] = pc_cycles[fetch_pc] + cycles - fetch_cycles;
+      fetch_cycles = cycles;
+    end
+    fetch_pc = m_machine.m_cpu.addr_bus;
+    fetches[fetch_pc] = fetches[fetch_pc] + 1;
+  end
+
+  // Written at halt with +profile, one "address fetches cycles" line per
+  // address that was executed, for asm/profile.py
+  integer profile;
+  reg [7:0] address;
+  task write_profile;
+    begin
+      pc_cycles[fetch_pc] = pc_cycles[fetch_pc] + cycles - fetch_cycles;
+      profile = $fopen(profile_path, "w");
+      for (i = 0; i < 256; i = i + 1) begin
+        address = i;
+        if (fetches[i] > 0)
+          $fdisplay(profile, "%h %0d %0d", address, fetches[i], pc_cycles[i]);
+      end
+      $fclose(profile);
+    end
+  endtask
+
   initial begin
-    $readmemh("memory.list", m_machine.m_ram.mem);
-    $dumpfile("machine.vcd");
-    $dumpvars(0, m_machine);
+    for (i = 0; i < 256; i = i + 1) begin
+      fetches[i] = 0;
+      pc_cycles[i] = 0;
+    end
+    if (!$value$plusargs("memory=%s", memory_path)) memory_path = "memory.list";
+    if (!$value$plusargs("vcd=%s", vcd_path)) vcd_path = "machine.vcd";
+    if (!$value$plusargs("profile=%s", profile_path)) profile_path = "profile.txt";
+    if (!$value$plusargs("max_cycles=%d", max_cycles)) max_cycles = 0;
+
+    $readmemh(memory_path, m_machine.m_ram.mem);
+    if (!$test$plusargs("no_vcd")) begin
+      $dumpfile(vcd_path);
+      $dumpvars(0, m_machine);
+    end
 
     # 10 reset = 1;
     # 10 reset = 0;
@@ -51,6 +127,10 @@ module machine_tb;
       m_machine.m_cpu.m_registers.regg,
       m_machine.m_cpu.m_registers.regt
     );
+    $display("Cycles: %0d", cycles);
+    $display("Instructions: %0d", instructions);
+    if ($test$plusargs("profile"))
+      write_profile;
     $stop;
   end
 
@@ -1,3 +1,19 @@
+; The same calls in SimpleLang. Compiled by tasks/6 assemblycode with
+; -no-inline they print the same values in the same 70 cycles: 42 is passed
+; to output in B, and main loads 10 again instead of load saving A.
+;
+;   void output(int v) {
+;       out(v);
+;   }
+;
+;   void load() {
+;       output(42);
+;   }
+;
+;   out(10);
+;   load();
+;   out(10);
+
 .text
 
 start:
@@ -0,0 +1,64 @@
+#!/usr/bin/env bash
+# Run every test program and compare its cycle count at halt with the
+# budget in tests/cycles.txt. Prints a table of the differences and fails
+# when a program is slower than its budget by more than TOLERANCE percent
+# (default 1), or has no budget.
+#
+#   tests/cycles.sh             check
+#   tests/cycles.sh --update    write the current counts as the new budgets
+
+cd "$(dirname "$0")/.." || exit 1
+
+BASELINE=tests/cycles.txt
+TOLERANCE=${TOLERANCE:-1}
+UPDATE=0
+[ "$1" = "--update" ] && UPDATE=1
+
+results=$(mktemp)
+trap 'rm -f "$results"' EXIT
+
+# Programs that did not halt are listed with 0 cycles
+./tests/run.sh | awk '$1 ~ /\.asm$/ { print $1, $2 == "halted" ? $3 : 0, $4 }' > "$results"
+[ -s "$results" ] || exit 1
+
+if [ "$UPDATE" = 1 ]; then
+  {
+    sed -n '/^#/p' "$BASELINE"
+    awk '{ printf "%-26s %7d %13d\n", $1, $2, $3 }' "$results"
+  } > "$BASELINE.new" && mv "$BASELINE.new" "$BASELINE"
+  echo "Updated $BASELINE"
+  exit 0
+fi
+
+awk -v tolerance="$TOLERANCE" '
+  FNR == NR {
+    if ($0 !~ /^#/ && NF >= 2) budget[$1] = $2
+    next
+  }
+  FNR == 1 {
+    printf "%-26s %7s %7s %7s %8s %13s\n", "test", "budget", "cycles", "diff", "%", "instructions"
+  }
+  {
+    if ($2 == 0) {
+      printf "%-26s %7s %7s %7s %8s %13s  did not halt\n", $1, budget[$1], "-", "-", "-", "-"
+      failed = 1
+      next
+    }
+    if (!($1 in budget)) {
+      printf "%-26s %7s %7d %7s %8s %13d  no budget\n", $1, "-", $2, "-", "-", $3
+      failed = 1
+      next
+    }
+    diff = $2 - budget[$1]
+    percent = budget[$1] ? 100 * diff / budget[$1] : 0
+    status = ""
+    if (percent > tolerance) {
+      status = "  REGRESSION"
+      failed = 1
+    } else if (diff < 0) {
+      status = "  faster, run tests/cycles.sh --update"
+    }
+    printf "%-26s %7d %7d %+7d %+7.1f%% %13d%s\n", $1, budget[$1], $2, diff, percent, $3, status
+  }
+  END { exit failed }
+' "$BASELINE" "$results"
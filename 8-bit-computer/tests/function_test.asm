@@ -0,0 +1,72 @@
+; Generated by tasks/6 assemblycode from:
+;
+;   int mul(int a, int b) {
+;       int r;
+;       while (b > 0) {
+;           r = r + a;
+;           b = b - 1;
+;       }
+;       return r;
+;   }
+;
+;   int x;
+;   int y;
+;   int z;
+;   x = mul(3, 4);
+;   y = mul(x, 5);
+;   z = mul(y - x, 2);
+;
+; mul is too big to be worth inlining three times, so it is called with its
+; arguments in B and C and returns its result in A.
+
+.text
+    ldi B 3
+    ldi C 4
+    call %mul
+    sta %x_2
+    mov B A
+    ldi C 5
+    call %mul
+    sta %y_4
+    mov B M %x_2
+    sub
+    mov B A
+    ldi C 2
+    call %mul
+    sta %z_7
+    lda %x_2
+    out 0
+    lda %y_4
+    out 0
+    lda %z_7
+    out 0
+    hlt
+mul:
+    mov M B %a_12
+    mov M C %b_18
+    ldi A 0
+    sta %r_15
+    jmp %_bb4
+_bb3:
+    lda %r_15
+    mov B M %a_12
+    add
+    sta %r_15
+    lda %b_18
+    dec
+    sta %b_18
+_bb4:
+    ldi A 0
+    mov B M %b_18
+    cmp
+    jc %_bb3
+    lda %r_15
+    ret
+
+.data
+x_2 = 0
+y_4 = 0
+z_7 = 0
+a_12 = 0
+r_15 = 0
+b_18 = 0
@@ -0,0 +1,96 @@
+; Generated by tasks/6 assemblycode from:
+;
+;   int grade(int score) {
+;       if (score >= 90) {
+;           return 4;
+;       } else if (score >= 75) {
+;           return 3;
+;       } else if (score >= 50) {
+;           return 2;
+;       }
+;       return 0;
+;   }
+;
+;   int a;
+;   int b;
+;   int c;
+;   int n;
+;   a = grade(95);
+;   b = grade(60);
+;   c = grade(10);
+;   while (n < 3) {
+;       if (n == 1) {
+;           a = a + 10;
+;       } else {
+;           b = b + 10;
+;       }
+;       n = n + 1;
+;   }
+;
+; Each test of the else if chain is a cmp and a single jc to the next one.
+; The loop is unrolled, which settles every if/else inside it.
+
+.text
+    ldi B 95
+    call %grade
+    sta %a_1
+    ldi B 60
+    call %grade
+    sta %b_3
+    ldi B 10
+    call %grade
+    sta %c_5
+    lda %a_1
+    ldi B 10
+    add
+    sta %a_1
+    lda %b_3
+    ldi B 20
+    add
+    sta %b_3
+    lda %a_1
+    out 0
+    lda %b_3
+    out 0
+    lda %c_5
+    out 0
+    ldi A 3
+    out 0
+    hlt
+grade:
+    mov M B %score_54
+    lda %score_54
+    ldi B 90
+    cmp
+    jc %_bb13
+    ldi A 4
+    sta %score_54
+    jmp %_bb11
+_bb13:
+    lda %score_54
+    ldi B 75
+    cmp
+    jc %_bb17
+    ldi A 3
+    sta %score_54
+    jmp %_bb11
+_bb17:
+    lda %score_54
+    ldi B 50
+    cmp
+    jc %_bb21
+    ldi A 2
+    sta %score_54
+    jmp %_bb11
+_bb21:
+    ldi A 0
+    sta %score_54
+_bb11:
+    lda %score_54
+    ret
+
+.data
+a_1 = 0
+b_3 = 0
+c_5 = 0
+score_54 = 0
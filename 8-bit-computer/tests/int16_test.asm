@@ -0,0 +1,162 @@
+; Generated by tasks/6 assemblycode -int 16 from:
+;
+;   int fib(int n) {
+;       int a;
+;       int b;
+;       int t;
+;       b = 1;
+;       while (n > 0) {
+;           t = a + b;
+;           a = b;
+;           b = t;
+;           n = n - 1;
+;       }
+;       return a;
+;   }
+;
+;   int x;
+;   int y;
+;   int z;
+;   x = fib(24);
+;   y = x - fib(20);
+;   z = 1000;
+;   while (z < y) {
+;       z = z + z;
+;   }
+;
+; Every int is two bytes, low byte first, and out prints the high byte
+; first: x = 46368 ($b520), y = 39603 ($9ab3) and z = 64000 ($fa00). fib
+; takes its argument in B and C and returns its result in C and D. Adding
+; is add then adc, and the loop tests compare the high bytes first.
+
+.text
+    ldi B 24
+    ldi C 0
+    call %fib
+    mov M C %x_1
+    mov M D %x_1.1
+    ldi B 20
+    ldi C 0
+    call %fib
+    mov M C %_t3
+    mov M D %_t3.1
+    lda %x_1
+    mov B M %_t3
+    sub
+    sta %_t3
+    lda %x_1.1
+    mov B M %_t3.1
+    jnc %_w0
+    dec
+_w0:
+    sub
+    sta %_t3.1
+    jmp %_bb2
+_bb1:
+    lda %z_7
+    mov B M %z_7
+    add
+    sta %z_7
+    lda %z_7.1
+    mov B M %z_7.1
+    adc
+    sta %z_7.1
+_bb2:
+    lda %z_7.1
+    mov B M %_t3.1
+    cmp
+    jc %_bb1
+    jne %_bb3
+    lda %z_7
+    mov B M %_t3
+    cmp
+    jc %_bb1
+_bb3:
+    lda %x_1.1
+    out 0
+    lda %x_1
+    out 0
+    lda %_t3.1
+    out 0
+    lda %_t3
+    out 0
+    lda %z_7.1
+    out 0
+    lda %z_7
+    out 0
+    hlt
+fib:
+    mov M B %n_25
+    mov M C %n_25.1
+    ldi A 1
+    sta %b_21
+    ldi A 0
+    sta %b_21.1
+    ldi A 0
+    sta %a_20
+    ldi A 0
+    sta %a_20.1
+    jmp %_bb7
+_bb6:
+    lda %a_20
+    mov B M %b_21
+    add
+    sta %t_22
+    lda %a_20.1
+    mov B M %b_21.1
+    adc
+    sta %t_22.1
+    lda %n_25
+    dec
+    sta %n_25
+    lda %n_25.1
+    jnc %_w1
+    dec
+_w1:
+    sta %n_25.1
+    lda %t_22
+    push A
+    lda %t_22.1
+    push A
+    lda %b_21
+    push A
+    lda %b_21.1
+    push A
+    pop A
+    sta %a_20.1
+    pop A
+    sta %a_20
+    pop A
+    sta %b_21.1
+    pop A
+    sta %b_21
+_bb7:
+    ldi A 0
+    mov B M %n_25.1
+    cmp
+    jc %_bb6
+    jne %_bb8
+    ldi A 0
+    mov B M %n_25
+    cmp
+    jc %_bb6
+_bb8:
+    mov C M %a_20
+    mov D M %a_20.1
+    ret
+
+.data
+x_1 = 0
+x_1.1 = 0
+_t3 = 0
+_t3.1 = 0
+z_7 = 232
+z_7.1 = 3
+a_20 = 0
+a_20.1 = 0
+b_21 = 0
+b_21.1 = 0
+t_22 = 0
+t_22.1 = 0
+n_25 = 0
+n_25.1 = 0
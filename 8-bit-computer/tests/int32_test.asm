@@ -0,0 +1,132 @@
+; Generated by tasks/6 assemblycode -int 32 from:
+;
+;   int x;
+;   int y;
+;   int z;
+;   x = 1;
+;   while (x < 2000000000) {
+;       x = x + x;
+;   }
+;   y = x - 1;
+;   z = x - 16777215;
+;
+; x stops at 2147483648 ($80000000). Both subtractions borrow through
+; every byte: y = $7fffffff, and z = $7f000001, where the borrow passes
+; straight through the $ff bytes of 16777215 ($00ffffff).
+
+.text
+_bb1:
+    lda %x_2
+    mov B M %x_2
+    add
+    sta %x_2
+    lda %x_2.1
+    mov B M %x_2.1
+    adc
+    sta %x_2.1
+    lda %x_2.2
+    mov B M %x_2.2
+    adc
+    sta %x_2.2
+    lda %x_2.3
+    mov B M %x_2.3
+    adc
+    sta %x_2.3
+    lda %x_2.3
+    ldi B 119
+    cmp
+    jc %_bb1
+    jne %_bb3
+    lda %x_2.2
+    ldi B 53
+    cmp
+    jc %_bb1
+    jne %_bb3
+    lda %x_2.1
+    ldi B 148
+    cmp
+    jc %_bb1
+    jne %_bb3
+    lda %x_2
+    ldi B 0
+    cmp
+    jc %_bb1
+_bb3:
+    lda %x_2
+    dec
+    sta %y_8
+    lda %x_2.1
+    jnc %_w0
+    dec
+_w0:
+    sta %y_8.1
+    lda %x_2.2
+    jnc %_w1
+    dec
+_w1:
+    sta %y_8.2
+    lda %x_2.3
+    jnc %_w2
+    dec
+_w2:
+    sta %y_8.3
+    lda %x_2
+    ldi B 255
+    sub
+    sta %z_10
+    lda %x_2.1
+    jc %_w3
+    ldi B 255
+    sub
+_w3:
+    sta %z_10.1
+    lda %x_2.2
+    jc %_w4
+    ldi B 255
+    sub
+_w4:
+    sta %z_10.2
+    lda %x_2.3
+    jnc %_w5
+    dec
+_w5:
+    sta %z_10.3
+    lda %x_2.3
+    out 0
+    lda %x_2.2
+    out 0
+    lda %x_2.1
+    out 0
+    lda %x_2
+    out 0
+    lda %y_8.3
+    out 0
+    lda %y_8.2
+    out 0
+    lda %y_8.1
+    out 0
+    lda %y_8
+    out 0
+    lda %z_10.3
+    out 0
+    lda %z_10.2
+    out 0
+    lda %z_10.1
+    out 0
+    lda %z_10
+    out 0
+    hlt
+
+.data
+x_2 = 1
+x_2.1 = 0
+x_2.2 = 0
+x_2.3 = 0
+y_8 = 0
+y_8.1 = 0
+y_8.2 = 0
+y_8.3 = 0
+z_10 = 0
+z_10.1 = 0
+z_10.2 = 0
+z_10.3 = 0
@@ -0,0 +1,83 @@
+#!/usr/bin/env bash
+# Build the simulator once, then run test programs at the same time, each
+# in its own temporary directory, and print how each one ended, its cycle
+# and instruction counts and how long it took. Fails when a program does not
+# halt within MAX_CYCLES cycles (default 1000000).
+#
+#   tests/run.sh [-j jobs] [file.asm ...]    all of tests/*.asm by default
+#
+# The output of a program is kept in $KEEP/<name>.out when KEEP is set.
+
+cd "$(dirname "$0")/.." || exit 1
+
+JOBS=$(nproc 2>/dev/null || echo 4)
+MAX_CYCLES=${MAX_CYCLES:-1000000}
+if [ "$1" = "-j" ]; then
+  JOBS=$2
+  shift 2
+fi
+if [ $# -eq 0 ]; then
+  set -- tests/*.asm
+fi
+
+make -s build || exit 1
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+now() {
+  date +%s%N
+}
+
+# run <index> <file.asm>: writes $work/<index>/result as
+# "name status cycles instructions milliseconds"
+run() {
+  local dir="$work/$1" name
+  name=$(basename "$2")
+  mkdir "$dir"
+  local start=$(now)
+  if ./asm/asm.py "$2" > "$dir/memory.list"; then
+    (cd "$dir" && vvp -n "$OLDPWD/computer" +memory=memory.list +no_vcd +max_cycles="$MAX_CYCLES" > output)
+  fi
+  local end=$(now)
+  [ -n "$KEEP" ] && cp "$dir/output" "$KEEP/${name%.asm}.out" 2>/dev/null
+  awk -v name="$name" -v ms=$(( (end - start) / 1000000 )) '
+    /^CPU halted normally/ { status = "halted" }
+    /^CPU stopped after/   { status = "limit" }
+    /^Cycles:/             { cycles = $2 }
+    /^Instructions:/       { instructions = $2 }
+    END {
+      if (status == "") status = "failed"
+      print name, status, cycles + 0, instructions + 0, ms
+    }' "$dir/output" 2>/dev/null > "$dir/result" || echo "$name failed 0 0 0" > "$dir/result"
+}
+
+start=$(now)
+index=0
+for asm_file in "$@"; do
+  while [ "$(jobs -rp | wc -l)" -ge "$JOBS" ]; do
+    wait -n
+  done
+  run "$index" "$asm_file" &
+  index=$((index + 1))
+done
+wait
+elapsed=$(( ($(now) - start) / 1000000 ))
+
+for ((i = 0; i < index; i++)); do
+  cat "$work/$i/result"
+done | awk -v elapsed="$elapsed" -v jobs="$JOBS" '
+  BEGIN {
+    printf "%-26s %-7s %9s %13s %9s\n", "test", "status", "cycles", "instructions", "ms"
+  }
+  {
+    printf "%-26s %-7s %9d %13d %9d\n", $1, $2, $3, $4, $5
+    total += $5
+    if ($2 != "halted") failed++
+  }
+  END {
+    printf "%d programs in %d ms on %d jobs (%d ms one after the other)", NR, elapsed, jobs, total
+    if (failed) printf ", %d did not halt", failed
+    printf "\n"
+    exit failed > 0
+  }'
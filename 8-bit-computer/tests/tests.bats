@@ -1,10 +1,17 @@
 #!/usr/bin/env bats
 
+# The simulator is built once; every test runs it on its own memory image,
+# so the tests can run in parallel (bats --jobs)
+function setup_file() {
+  make clean
+  make build
+}
+
 function compile_and_run() {
   local asm_file="$1"
-  ./asm/asm.py "./tests/${asm_file}" > ./memory.list
-  make clean
-  make run
+  shift
+  ./asm/asm.py "./tests/${asm_file}" > "$BATS_TEST_TMPDIR/memory.list"
+  vvp -n computer +memory="$BATS_TEST_TMPDIR/memory.list" +no_vcd +max_cycles=1000000 "$@"
 }
 
 @test "test I/O" {
@@ -26,3 +33,48 @@ function compile_and_run() {
 @test "test mov" {
   compile_and_run mov_test.asm | awk '/Output:/ { print $2; }' | tr '\n' ' ' | grep '42 21'
 }
+
+@test "test while" {
+  compile_and_run while_test.asm | awk '/Output:/ { print $2; }' | tr '\n' ' ' | grep '11 58 3'
+}
+
+@test "test function" {
+  compile_and_run function_test.asm | awk '/Output:/ { print $2; }' | tr '\n' ' ' | grep '12 60 96'
+}
+
+@test "test if" {
+  compile_and_run if_test.asm | awk '/Output:/ { print $2; }' | tr '\n' ' ' | grep '14 22 0 3'
+}
+
+@test "test 16-bit ints" {
+  compile_and_run int16_test.asm | awk '/Output:/ { print $2; }' | tr '\n' ' ' | grep '181 32 154 179 250 0'
+}
+
+@test "test 32-bit ints" {
+  compile_and_run int32_test.asm | awk '/Output:/ { print $2; }' | tr '\n' ' ' | grep '128 0 0 0 127 255 255 255 127 0 0 1'
+}
+
+@test "object files load to the same memory image" {
+  for asm_file in tests/*.asm; do
+    ./asm/asm.py "$asm_file" -o "$BATS_TEST_TMPDIR/test.obj" > "$BATS_TEST_TMPDIR/direct.list"
+    ./asm/objload.py "$BATS_TEST_TMPDIR/test.obj" | cmp - "$BATS_TEST_TMPDIR/direct.list"
+  done
+}
+
+@test "profile accounts for every cycle" {
+  ./asm/asm.py tests/function_test.asm -m "$BATS_TEST_TMPDIR/memory.map" > /dev/null
+  result=$(compile_and_run function_test.asm +profile="$BATS_TEST_TMPDIR/profile.txt")
+  cycles=$(echo "$result" | awk '/^Cycles:/ { print $2 }')
+  instructions=$(echo "$result" | awk '/^Instructions:/ { print $2 }')
+  ./asm/profile.py "$BATS_TEST_TMPDIR/memory.map" "$BATS_TEST_TMPDIR/profile.txt" | head -1 | grep ": $cycles cycles, $instructions instructions"
+}
+
+@test "programs that do not halt are stopped" {
+  printf '.text\nloop:\n    jmp %%loop\n' > "$BATS_TEST_TMPDIR/loop.asm"
+  ./asm/asm.py "$BATS_TEST_TMPDIR/loop.asm" > "$BATS_TEST_TMPDIR/memory.list"
+  vvp -n computer +memory="$BATS_TEST_TMPDIR/memory.list" +no_vcd +max_cycles=100 | grep 'CPU stopped after 100 cycles'
+}
+
+@test "cycle budgets" {
+  ./tests/cycles.sh
+}
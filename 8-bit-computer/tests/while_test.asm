@@ -0,0 +1,47 @@
+; Generated by tasks/6 assemblycode from:
+;
+;   int i;
+;   int sum;
+;   int n;
+;   i = 1;
+;   while (i <= 10) {
+;       sum = sum + i;
+;       i = i + 1;
+;   }
+;   while (n < 3) {
+;       sum = sum + n;
+;       n = n + 1;
+;   }
+;
+; The first loop is rotated and, since its first test is known to pass,
+; entered at its body. The second one is fully unrolled.
+
+.text
+_bb1:
+    lda %sum_2
+    mov B M %i_3
+    add
+    sta %sum_2
+    lda %i_3
+    inc
+    sta %i_3
+    mov B A
+    ldi A 10
+    cmp
+    jnc %_bb1
+    lda %sum_2
+    ldi B 3
+    add
+    sta %sum_19
+    lda %i_3
+    out 0
+    lda %sum_19
+    out 0
+    ldi A 3
+    out 0
+    hlt
+
+.data
+sum_2 = 0
+i_3 = 1
+sum_19 = 0
@@ -0,0 +1,66 @@
+#!/usr/bin/env bash
+# Cycle cost of SimpleLang operations on 8, 16 and 32-bit ints. Each
+# operation is compiled with -int into a program that gets a = 1000 and
+# b = 1001 from calls, so the compiler cannot fold them, and whose bytes
+# only differ at the bottom, so comparisons go through every byte. It is
+# run on the testbench next to the same program without the operation, and
+# the difference in cycles is printed.
+#
+#   tests/widths.sh
+#
+# COMPILER is the SimpleLang compiler, built from tasks/6 by default.
+
+cd "$(dirname "$0")/.." || exit 1
+
+OPERATIONS=(
+  "x = a + b;"
+  "x = a - b;"
+  "x = a + 1;"
+  "out(a);"
+  "if (a == b) {}"
+  "if (a != b) {}"
+  "if (a < b) {}"
+)
+WIDTHS="8 16 32"
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+if [ -z "$COMPILER" ]; then
+  COMPILER=$work/assemblycode
+  ${CC:-cc} -O2 -o "$COMPILER" "../tasks/6. Assembly Code Generation/assemblycode.c" || exit 1
+fi
+
+# Program 0 is the one without an operation
+for width in $WIDTHS; do
+  for ((i = 0; i <= ${#OPERATIONS[@]}; i++)); do
+    operation=""
+    [ "$i" -gt 0 ] && operation=${OPERATIONS[$((i - 1))]}
+    printf 'int k(int n) {\n    return n;\n}\nint a;\nint b;\nint x;\na = k(1000);\nb = k(1001);\n%s\n' \
+      "$operation" > "$work/op${i}_$width.sl"
+    "$COMPILER" -no-inline -int "$width" "$work/op${i}_$width.sl" > "$work/op${i}_$width.asm" || exit 1
+  done
+done
+
+./tests/run.sh "$work"/*.asm > "$work/results" || exit 1
+
+printf '%s\n' "${OPERATIONS[@]}" | awk -v widths="$WIDTHS" '
+  FNR == NR {
+    if ($1 ~ /\.asm$/) {
+      split($1, parts, /[_.]/)
+      cycles[parts[1], parts[2]] = $3
+    }
+    next
+  }
+  FNR == 1 {
+    count = split(widths, width, " ")
+    printf "%-18s", "operation"
+    for (w = 1; w <= count; w++) printf " %7s", width[w] "-bit"
+    printf "\n"
+  }
+  {
+    printf "%-18s", $0
+    for (w = 1; w <= count; w++) printf " %7d", cycles["op" FNR, width[w]] - cycles["op0", width[w]]
+    printf "\n"
+  }
+' "$work/results" -
@@ -10,15 +10,27 @@ typedef enum
 {
     TOKEN_INT,        // "int" keyword
     TOKEN_IF,         // "if" keyword
+    TOKEN_ELSE,       // "else" keyword
+    TOKEN_WHILE,      // "while" keyword
+    TOKEN_VOID,       // "void" keyword
+    TOKEN_RETURN,     // "return" keyword
     TOKEN_IDENTIFIER, // Variable names
     TOKEN_NUMBER,     // Numeric literals
     TOKEN_ASSIGN,     // "="
     TOKEN_PLUS,       // "+"
     TOKEN_MINUS,      // "-"
     TOKEN_EQUAL,      // "=="
+    TOKEN_NOT_EQUAL,  // "!="
+    TOKEN_LESS,       // "<"
+    TOKEN_GREATER,    // ">"
+    TOKEN_LESS_EQUAL, // "<="
+    TOKEN_GREATER_EQUAL, // ">="
     TOKEN_LBRACE,     // "{"
     TOKEN_RBRACE,     // "}"
+    TOKEN_LPAREN,     // "("
+    TOKEN_RPAREN,     // ")"
     TOKEN_SEMICOLON,  // ";"
+    TOKEN_COMMA,      // ","
     TOKEN_UNKNOWN,    // Unknown character
     TOKEN_EOF         // End of file
 } TokenType;
@@ -35,15 +47,27 @@ const char* getTokenTypeName(TokenType type) {
     switch (type) {
         case TOKEN_INT: return "TOKEN_INT";
         case TOKEN_IF: return "TOKEN_IF";
+        case TOKEN_ELSE: return "TOKEN_ELSE";
+        case TOKEN_WHILE: return "TOKEN_WHILE";
+        case TOKEN_VOID: return "TOKEN_VOID";
+        case TOKEN_RETURN: return "TOKEN_RETURN";
         case TOKEN_IDENTIFIER: return "TOKEN_IDENTIFIER";
         case TOKEN_NUMBER: return "TOKEN_NUMBER";
         case TOKEN_ASSIGN: return "TOKEN_ASSIGN";
         case TOKEN_PLUS: return "TOKEN_PLUS";
         case TOKEN_MINUS: return "TOKEN_MINUS";
         case TOKEN_EQUAL: return "TOKEN_EQUAL";
+        case TOKEN_NOT_EQUAL: return "TOKEN_NOT_EQUAL";
+        case TOKEN_LESS: return "TOKEN_LESS";
+        case TOKEN_GREATER: return "TOKEN_GREATER";
+        case TOKEN_LESS_EQUAL: return "TOKEN_LESS_EQUAL";
+        case TOKEN_GREATER_EQUAL: return "TOKEN_GREATER_EQUAL";
         case TOKEN_LBRACE: return "TOKEN_LBRACE";
         case TOKEN_RBRACE: return "TOKEN_RBRACE";
+        case TOKEN_LPAREN: return "TOKEN_LPAREN";
+        case TOKEN_RPAREN: return "TOKEN_RPAREN";
         case TOKEN_SEMICOLON: return "TOKEN_SEMICOLON";
+        case TOKEN_COMMA: return "TOKEN_COMMA";
         case TOKEN_UNKNOWN: return "TOKEN_UNKNOWN";
         case TOKEN_EOF: return "TOKEN_EOF";
         default: return "UNKNOWN";
@@ -83,6 +107,22 @@ void getNextToken(FILE *file, Token *token)
             {
                 token->type = TOKEN_IF;
             }
+            else if (strcmp(token->text, "else") == 0)
+            {
+                token->type = TOKEN_ELSE;
+            }
+            else if (strcmp(token->text, "while") == 0)
+            {
+                token->type = TOKEN_WHILE;
+            }
+            else if (strcmp(token->text, "void") == 0)
+            {
+                token->type = TOKEN_VOID;
+            }
+            else if (strcmp(token->text, "return") == 0)
+            {
+                token->type = TOKEN_RETURN;
+            }
             else
             {
                 token->type = TOKEN_IDENTIFIER; // Otherwise, it's an identifier
@@ -122,6 +162,45 @@ void getNextToken(FILE *file, Token *token)
                 strcpy(token->text, "=");
             }
             return;
+        case '!':
+            if ((c = fgetc(file)) == '=')
+            {
+                token->type = TOKEN_NOT_EQUAL;
+                strcpy(token->text, "!=");
+            }
+            else
+            {
+                ungetc(c, file);
+                token->type = TOKEN_UNKNOWN;
+                strcpy(token->text, "!");
+            }
+            return;
+        case '<':
+            if ((c = fgetc(file)) == '=')
+            {
+                token->type = TOKEN_LESS_EQUAL;
+                strcpy(token->text, "<=");
+            }
+            else
+            {
+                ungetc(c, file);
+                token->type = TOKEN_LESS;
+                strcpy(token->text, "<");
+            }
+            return;
+        case '>':
+            if ((c = fgetc(file)) == '=')
+            {
+                token->type = TOKEN_GREATER_EQUAL;
+                strcpy(token->text, ">=");
+            }
+            else
+            {
+                ungetc(c, file);
+                token->type = TOKEN_GREATER;
+                strcpy(token->text, ">");
+            }
+            return;
         case '+':
             token->type = TOKEN_PLUS;
             strcpy(token->text, "+");
@@ -138,10 +217,22 @@ void getNextToken(FILE *file, Token *token)
             token->type = TOKEN_RBRACE;
             strcpy(token->text, "}");
             return;
+        case '(':
+            token->type = TOKEN_LPAREN;
+            strcpy(token->text, "(");
+            return;
+        case ')':
+            token->type = TOKEN_RPAREN;
+            strcpy(token->text, ")");
+            return;
         case ';':
             token->type = TOKEN_SEMICOLON;
             strcpy(token->text, ";");
             return;
+        case ',':
+            token->type = TOKEN_COMMA;
+            strcpy(token->text, ",");
+            return;
         default:
             token->type = TOKEN_UNKNOWN;
             token->text[0] = c;
@@ -9,12 +9,18 @@
 typedef enum {
     TOKEN_INT,        // "int" keyword
     TOKEN_IF,         // "if" keyword
+    TOKEN_ELSE,       // "else" keyword
+    TOKEN_WHILE,      // "while" keyword
+    TOKEN_VOID,       // "void" keyword
+    TOKEN_RETURN,     // "return" keyword
     TOKEN_IDENTIFIER, // Variable names
     TOKEN_NUMBER,     // Numeric literals
     TOKEN_ASSIGN,     // "="
     TOKEN_PLUS,       // "+"
     TOKEN_MINUS,      // "-"
+    TOKEN_COMPARE,    // "==", "!=", "<", ">", "<=", ">="
     TOKEN_SEMICOLON,  // ";"
+    TOKEN_COMMA,      // ","
     TOKEN_LBRACE,     // "{"
     TOKEN_RBRACE,     // "}"
     TOKEN_LPAREN,     // "("
@@ -34,9 +40,14 @@ typedef enum {
     AST_VAR_DECL,
     AST_ASSIGNMENT,
     AST_BINARY_EXPR,
-    AST_IF_STATEMENT,
+    AST_IF_STATEMENT,   // Else branch in right
+    AST_ELSE,           // A block in body, or a single 'if'
+    AST_WHILE_STATEMENT,
     AST_LITERAL,
-    AST_IDENTIFIER
+    AST_IDENTIFIER,
+    AST_FUNCTION,       // Parameters in left, linked through 'next'
+    AST_CALL,           // Arguments in left, linked through 'next'
+    AST_RETURN
 } ASTNodeType;
 
 // AST Node Structure
@@ -45,19 +56,29 @@ typedef struct ASTNode {
     char value[MAX_TOKEN_LEN]; // For literals and identifiers
     struct ASTNode *left;      // Left child (for binary expressions)
     struct ASTNode *right;     // Right child (for binary expressions)
-    struct ASTNode *body;      // Body (for if statements)
+    struct ASTNode *body;      // Body (for if and while statements)
+    struct ASTNode *next;      // Next statement in the same block
 } ASTNode;
 
 // Global current token
 Token current_token;
+int nesting = 0; // Depth of braces while parsing
 
 // Function prototypes
 void getNextToken(FILE *file, Token *token);
 ASTNode* parseProgram(FILE *file);
+ASTNode* parseBlock(FILE *file);
+ASTNode* parseStatement(FILE *file);
 ASTNode* parseVarDecl(FILE *file);
 ASTNode* parseAssignment(FILE *file);
+ASTNode* parsePrimary(FILE *file);
 ASTNode* parseExpression(FILE *file);
+ASTNode* parseCondition(FILE *file);
 ASTNode* parseIfStatement(FILE *file);
+ASTNode* parseWhileStatement(FILE *file);
+ASTNode* parseFunction(FILE *file, const char *name);
+ASTNode* parseCall(FILE *file, const char *name);
+ASTNode* parseReturn(FILE *file);
 void printAST(ASTNode *node, int indent);
 void error(const char *message);
 
@@ -90,6 +111,14 @@ void getNextToken(FILE *file, Token *token) {
             token->type = TOKEN_INT;
         } else if (strcmp(token->text, "if") == 0) {
             token->type = TOKEN_IF;
+        } else if (strcmp(token->text, "else") == 0) {
+            token->type = TOKEN_ELSE;
+        } else if (strcmp(token->text, "while") == 0) {
+            token->type = TOKEN_WHILE;
+        } else if (strcmp(token->text, "void") == 0) {
+            token->type = TOKEN_VOID;
+        } else if (strcmp(token->text, "return") == 0) {
+            token->type = TOKEN_RETURN;
         } else {
             token->type = TOKEN_IDENTIFIER;
         }
@@ -110,6 +139,21 @@ void getNextToken(FILE *file, Token *token) {
         return;
     }
 
+    if (c == '=' || c == '!' || c == '<' || c == '>') {
+        int next = fgetc(file);
+        if (next == '=') {
+            token->type = TOKEN_COMPARE;
+            sprintf(token->text, "%c=", c);
+            return;
+        }
+        ungetc(next, file);
+        if (c == '<' || c == '>') {
+            token->type = TOKEN_COMPARE;
+            sprintf(token->text, "%c", c);
+            return;
+        }
+    }
+
     switch (c) {
         case '=': token->type = TOKEN_ASSIGN; strcpy(token->text, "="); break;
         case '+': token->type = TOKEN_PLUS; strcpy(token->text, "+"); break;
@@ -119,6 +163,7 @@ void getNextToken(FILE *file, Token *token) {
         case ';': token->type = TOKEN_SEMICOLON; strcpy(token->text, ";"); break;
         case '(': token->type = TOKEN_LPAREN; strcpy(token->text, "("); break;
         case ')': token->type = TOKEN_RPAREN; strcpy(token->text, ")"); break;
+        case ',': token->type = TOKEN_COMMA; strcpy(token->text, ","); break;
         default: token->type = TOKEN_UNKNOWN; sprintf(token->text, "%c", c); break;
     }
 }
@@ -134,7 +179,7 @@ ASTNode* createASTNode(ASTNodeType type, const char *value) {
     ASTNode *node = (ASTNode *)malloc(sizeof(ASTNode));
     node->type = type;
     strcpy(node->value, value ? value : "");
-    node->left = node->right = node->body = NULL;
+    node->left = node->right = node->body = node->next = NULL;
     return node;
 }
 
@@ -142,37 +187,65 @@ ASTNode* createASTNode(ASTNodeType type, const char *value) {
 ASTNode* parseProgram(FILE *file) {
     getNextToken(file, &current_token);
     ASTNode *root = createASTNode(AST_LITERAL, "Program");
+    root->body = parseBlock(file);
 
-    while (current_token.type != TOKEN_EOF) {
-        if (current_token.type == TOKEN_INT) {
-            ASTNode *varDecl = parseVarDecl(file);
-            varDecl->left = root->body;
-            root->body = varDecl;
-        } else if (current_token.type == TOKEN_IDENTIFIER) {
-            ASTNode *assign = parseAssignment(file);
-            assign->left = root->body;
-            root->body = assign;
-        } else if (current_token.type == TOKEN_IF) {
-            ASTNode *ifStmt = parseIfStatement(file);
-            ifStmt->left = root->body;
-            root->body = ifStmt;
-        } else {
-            error("Unexpected token");
-        }
+    if (current_token.type != TOKEN_EOF) {
+        error("Unexpected token");
     }
 
     return root;
 }
 
+// Parses statements until '}' or end of file, linked through 'next'
+ASTNode* parseBlock(FILE *file) {
+    ASTNode *head = NULL;
+    ASTNode **tail = &head;
+
+    while (current_token.type != TOKEN_EOF && current_token.type != TOKEN_RBRACE) {
+        *tail = parseStatement(file);
+        tail = &(*tail)->next;
+    }
+
+    return head;
+}
+
+ASTNode* parseStatement(FILE *file) {
+    if (current_token.type == TOKEN_INT || current_token.type == TOKEN_VOID) {
+        return parseVarDecl(file);
+    } else if (current_token.type == TOKEN_IDENTIFIER) {
+        return parseAssignment(file);
+    } else if (current_token.type == TOKEN_IF) {
+        return parseIfStatement(file);
+    } else if (current_token.type == TOKEN_WHILE) {
+        return parseWhileStatement(file);
+    } else if (current_token.type == TOKEN_RETURN) {
+        return parseReturn(file);
+    }
+
+    error("Unexpected token");
+    return NULL;
+}
+
+// 'int' <identifier> ';', or a function definition after 'int' or 'void'
 ASTNode* parseVarDecl(FILE *file) {
-    getNextToken(file, &current_token); // Consume 'int'
+    int isVoid = current_token.type == TOKEN_VOID;
+    getNextToken(file, &current_token); // Consume 'int' or 'void'
 
     if (current_token.type != TOKEN_IDENTIFIER) {
-        error("Expected identifier after 'int'");
+        error("Expected identifier after type");
     }
     ASTNode *varDecl = createASTNode(AST_VAR_DECL, current_token.text);
     getNextToken(file, &current_token); // Consume identifier
 
+    if (current_token.type == TOKEN_LPAREN) {
+        ASTNode *function = parseFunction(file, varDecl->value);
+        free(varDecl);
+        return function;
+    }
+    if (isVoid) {
+        error("Expected '(' after function name");
+    }
+
     if (current_token.type != TOKEN_SEMICOLON) {
         error("Expected ';' after variable declaration");
     }
@@ -181,10 +254,105 @@ ASTNode* parseVarDecl(FILE *file) {
     return varDecl;
 }
 
+// '(' [ 'int' <identifier> { ',' 'int' <identifier> } ] ')' '{' <block> '}',
+// after the function's name
+ASTNode* parseFunction(FILE *file, const char *name) {
+    if (nesting > 0) {
+        error("Function defined inside a block");
+    }
+    ASTNode *function = createASTNode(AST_FUNCTION, name);
+    ASTNode **tail = &function->left;
+    getNextToken(file, &current_token); // Consume '('
+
+    while (current_token.type != TOKEN_RPAREN) {
+        if (function->left) {
+            if (current_token.type != TOKEN_COMMA) {
+                error("Expected ',' between parameters");
+            }
+            getNextToken(file, &current_token); // Consume ','
+        }
+        if (current_token.type != TOKEN_INT) {
+            error("Expected 'int' before parameter");
+        }
+        getNextToken(file, &current_token); // Consume 'int'
+        if (current_token.type != TOKEN_IDENTIFIER) {
+            error("Expected parameter name");
+        }
+        *tail = createASTNode(AST_VAR_DECL, current_token.text);
+        tail = &(*tail)->next;
+        getNextToken(file, &current_token); // Consume identifier
+    }
+    getNextToken(file, &current_token); // Consume ')'
+
+    if (current_token.type != TOKEN_LBRACE) {
+        error("Expected '{' before function body");
+    }
+    getNextToken(file, &current_token); // Consume '{'
+    nesting++;
+    function->body = parseBlock(file);
+    nesting--;
+
+    if (current_token.type != TOKEN_RBRACE) {
+        error("Expected '}' after function body");
+    }
+    getNextToken(file, &current_token); // Consume '}'
+
+    return function;
+}
+
+// '(' [ <expression> { ',' <expression> } ] ')', after the function's name
+ASTNode* parseCall(FILE *file, const char *name) {
+    ASTNode *call = createASTNode(AST_CALL, name);
+    ASTNode **tail = &call->left;
+    getNextToken(file, &current_token); // Consume '('
+
+    while (current_token.type != TOKEN_RPAREN) {
+        if (call->left) {
+            if (current_token.type != TOKEN_COMMA) {
+                error("Expected ',' between arguments");
+            }
+            getNextToken(file, &current_token); // Consume ','
+        }
+        *tail = parseExpression(file);
+        tail = &(*tail)->next;
+    }
+    getNextToken(file, &current_token); // Consume ')'
+
+    return call;
+}
+
+// 'return' [ <expression> ] ';'
+ASTNode* parseReturn(FILE *file) {
+    getNextToken(file, &current_token); // Consume 'return'
+
+    ASTNode *ret = createASTNode(AST_RETURN, "return");
+    if (current_token.type != TOKEN_SEMICOLON) {
+        ret->left = parseExpression(file);
+    }
+
+    if (current_token.type != TOKEN_SEMICOLON) {
+        error("Expected ';' after return");
+    }
+    getNextToken(file, &current_token); // Consume ';'
+
+    return ret;
+}
+
+// An assignment, or a call made as a statement
 ASTNode* parseAssignment(FILE *file) {
     ASTNode *assign = createASTNode(AST_ASSIGNMENT, current_token.text); // Save identifier
     getNextToken(file, &current_token); // Consume identifier
 
+    if (current_token.type == TOKEN_LPAREN) {
+        ASTNode *call = parseCall(file, assign->value);
+        free(assign);
+        if (current_token.type != TOKEN_SEMICOLON) {
+            error("Expected ';' after call");
+        }
+        getNextToken(file, &current_token); // Consume ';'
+        return call;
+    }
+
     if (current_token.type != TOKEN_ASSIGN) {
         error("Expected '=' in assignment");
     }
@@ -199,7 +367,7 @@ ASTNode* parseAssignment(FILE *file) {
     return assign;
 }
 
-ASTNode* parseExpression(FILE *file) {
+ASTNode* parsePrimary(FILE *file) {
     ASTNode *expr = NULL;
 
     if (current_token.type == TOKEN_NUMBER || current_token.type == TOKEN_IDENTIFIER) {
@@ -208,6 +376,11 @@ ASTNode* parseExpression(FILE *file) {
             current_token.text
         );
         getNextToken(file, &current_token);
+        if (expr->type == AST_IDENTIFIER && current_token.type == TOKEN_LPAREN) {
+            ASTNode *call = parseCall(file, expr->value);
+            free(expr);
+            expr = call;
+        }
     } else {
         error("Expected literal or identifier in expression");
     }
@@ -215,46 +388,123 @@ ASTNode* parseExpression(FILE *file) {
     return expr;
 }
 
-ASTNode* parseIfStatement(FILE *file) {
-    getNextToken(file, &current_token); // Consume 'if'
+// <primary> { ('+' | '-') <primary> }, left associative
+ASTNode* parseExpression(FILE *file) {
+    ASTNode *expr = parsePrimary(file);
+
+    while (current_token.type == TOKEN_PLUS || current_token.type == TOKEN_MINUS) {
+        ASTNode *binary = createASTNode(AST_BINARY_EXPR, current_token.text);
+        getNextToken(file, &current_token); // Consume operator
+        binary->left = expr;
+        binary->right = parsePrimary(file);
+        expr = binary;
+    }
 
+    return expr;
+}
+
+// '(' <expression> [ <comparison> <expression> ] ')'
+ASTNode* parseCondition(FILE *file) {
     if (current_token.type != TOKEN_LPAREN) {
-        error("Expected '(' after 'if'");
+        error("Expected '(' before condition");
     }
     getNextToken(file, &current_token); // Consume '('
 
     ASTNode *condition = parseExpression(file);
 
+    if (current_token.type == TOKEN_COMPARE) {
+        ASTNode *compare = createASTNode(AST_BINARY_EXPR, current_token.text);
+        getNextToken(file, &current_token); // Consume comparison
+        compare->left = condition;
+        compare->right = parseExpression(file);
+        condition = compare;
+    }
+
     if (current_token.type != TOKEN_RPAREN) {
         error("Expected ')' after condition");
     }
     getNextToken(file, &current_token); // Consume ')'
 
+    return condition;
+}
+
+ASTNode* parseIfStatement(FILE *file) {
+    getNextToken(file, &current_token); // Consume 'if'
+
+    ASTNode *ifStmt = createASTNode(AST_IF_STATEMENT, "if");
+    ifStmt->left = parseCondition(file);
+
     if (current_token.type != TOKEN_LBRACE) {
         error("Expected '{' after if condition");
     }
     getNextToken(file, &current_token); // Consume '{'
 
-    ASTNode *ifStmt = createASTNode(AST_IF_STATEMENT, "if");
-    ifStmt->left = condition;
-    ifStmt->body = parseProgram(file);
+    nesting++;
+    ifStmt->body = parseBlock(file);
+    nesting--;
 
     if (current_token.type != TOKEN_RBRACE) {
         error("Expected '}' after if body");
     }
     getNextToken(file, &current_token); // Consume '}'
 
+    if (current_token.type == TOKEN_ELSE) {
+        getNextToken(file, &current_token); // Consume 'else'
+        ifStmt->right = createASTNode(AST_ELSE, "else");
+        if (current_token.type == TOKEN_IF) {
+            ifStmt->right->body = parseIfStatement(file);
+        } else {
+            if (current_token.type != TOKEN_LBRACE) {
+                error("Expected '{' or 'if' after else");
+            }
+            getNextToken(file, &current_token); // Consume '{'
+
+            nesting++;
+            ifStmt->right->body = parseBlock(file);
+            nesting--;
+
+            if (current_token.type != TOKEN_RBRACE) {
+                error("Expected '}' after else body");
+            }
+            getNextToken(file, &current_token); // Consume '}'
+        }
+    }
+
     return ifStmt;
 }
 
+ASTNode* parseWhileStatement(FILE *file) {
+    getNextToken(file, &current_token); // Consume 'while'
+
+    ASTNode *whileStmt = createASTNode(AST_WHILE_STATEMENT, "while");
+    whileStmt->left = parseCondition(file);
+
+    if (current_token.type != TOKEN_LBRACE) {
+        error("Expected '{' after while condition");
+    }
+    getNextToken(file, &current_token); // Consume '{'
+
+    nesting++;
+    whileStmt->body = parseBlock(file);
+    nesting--;
+
+    if (current_token.type != TOKEN_RBRACE) {
+        error("Expected '}' after while body");
+    }
+    getNextToken(file, &current_token); // Consume '}'
+
+    return whileStmt;
+}
+
 // AST Printing
 void printAST(ASTNode *node, int indent) {
     if (!node) return;
     for (int i = 0; i < indent; i++) printf("  ");
     printf("%s\n", node->value);
     printAST(node->left, indent + 1);
-    printAST(node->right, indent + 1);
     printAST(node->body, indent + 1);
+    printAST(node->right, indent + 1);
+    printAST(node->next, indent);
 }
 
 // Main Function
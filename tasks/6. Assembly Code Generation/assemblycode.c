@@ -2,10 +2,38 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <time.h>
+#include <setjmp.h>
+
+#include "superopt.h"
+
+// Loop optimization limits (memory is only 256 bytes, so keep code growth small)
+#define MAX_UNROLL_TRIPS      8
+#define MAX_UNROLL_STATEMENTS 16
+#define MAX_SYMBOLS           64
+#define MAX_LOOPS             64
+#define MAX_FUNCTIONS         16
+#define MAX_PARAMS            6      // Argument bytes are passed in B to G
+
+// Inlining: a call costs CALL_CYCLES for call and ret, plus ARGUMENT_CYCLES
+// for each argument to move it into its register and store it on entry.
+// Inlining is worth one extra byte of code for every INLINE_CYCLES_PER_BYTE
+// cycles it saves.
+#define CALL_CYCLES            14
+#define ARGUMENT_CYCLES        12
+#define INLINE_CYCLES_PER_BYTE 4
+
+// Adding or subtracting a constant takes ldi B k and add or sub, unless
+// add_constant has something faster or shorter
+#define CONSTANT_OPERAND_CYCLES 10
+#define CONSTANT_OPERAND_BYTES  3
 
 // Define Token Types
 typedef enum {
     TOKEN_INT,
+    TOKEN_VOID,
+    TOKEN_RETURN,
     TOKEN_IDENTIFIER,
     TOKEN_NUMBER,
     TOKEN_ASSIGN,
@@ -13,10 +41,19 @@ typedef enum {
     TOKEN_MINUS,
     TOKEN_SEMICOLON,
     TOKEN_IF,
+    TOKEN_ELSE,
+    TOKEN_WHILE,
+    TOKEN_EQUAL,
+    TOKEN_NOT_EQUAL,
+    TOKEN_LESS,
+    TOKEN_GREATER,
+    TOKEN_LESS_EQUAL,
+    TOKEN_GREATER_EQUAL,
     TOKEN_LBRACE,
     TOKEN_RBRACE,
     TOKEN_LPAREN,
     TOKEN_RPAREN,
+    TOKEN_COMMA,
     TOKEN_EOF,
     TOKEN_UNKNOWN
 } TokenType;
@@ -32,9 +69,13 @@ typedef enum {
     AST_VAR_DECL,
     AST_ASSIGN,
     AST_BINARY_OP,
-    AST_IF,
+    AST_IF,         // Else branch in right: a block, or a single 'if'
+    AST_WHILE,
     AST_LITERAL,
-    AST_IDENTIFIER
+    AST_IDENTIFIER,
+    AST_FUNCTION,   // Parameters in left, linked through 'next'
+    AST_CALL,       // Arguments in left, linked through 'next'
+    AST_RETURN
 } ASTNodeType;
 
 // AST Node Structure
@@ -45,18 +86,38 @@ typedef struct ASTNode {
     struct ASTNode *right;
     struct ASTNode *condition;
     struct ASTNode *body;
+    struct ASTNode *next;      // Next statement in a block
+    int returns;               // Function returns a value
 } ASTNode;
 
 // Global Variables
 Token current_token;
 FILE *input_file;
+char symbols[MAX_SYMBOLS][100];
+int symbol_scope[MAX_SYMBOLS];   // Function the variable belongs to, -1 for the program
+int symbol_count = 0;
+int current_scope = -1;
+int nesting = 0;                 // Depth of braces while parsing
+int optimize = 1;
+int inline_calls = 1;
+int int_bytes = 1;               // Width of int: 1, 2 or 4 bytes (-int 8, 16 or 32)
+unsigned int_mask = 0xFF;
+jmp_buf *on_error = NULL;        // Set while -run goes through several programs
+
+// Give up on the program once its error is printed: exit, or with -run
+// go back to runProgram for the next one
+_Noreturn void fail() {
+    if (on_error) longjmp(*on_error, 1);
+    exit(1);
+}
 
 // Function to Create AST Nodes
 ASTNode *createASTNode(ASTNodeType type, const char *value) {
     ASTNode *node = (ASTNode *)malloc(sizeof(ASTNode));
     node->type = type;
-    if (value) strcpy(node->value, value);
-    node->left = node->right = node->condition = node->body = NULL;
+    strcpy(node->value, value ? value : "");
+    node->left = node->right = node->condition = node->body = node->next = NULL;
+    node->returns = 0;
     return node;
 }
 
@@ -75,6 +136,10 @@ void getNextToken(FILE *file, Token *token) {
 
             if (strcmp(token->text, "int") == 0) token->type = TOKEN_INT;
             else if (strcmp(token->text, "if") == 0) token->type = TOKEN_IF;
+            else if (strcmp(token->text, "else") == 0) token->type = TOKEN_ELSE;
+            else if (strcmp(token->text, "while") == 0) token->type = TOKEN_WHILE;
+            else if (strcmp(token->text, "void") == 0) token->type = TOKEN_VOID;
+            else if (strcmp(token->text, "return") == 0) token->type = TOKEN_RETURN;
             else token->type = TOKEN_IDENTIFIER;
             return;
         }
@@ -89,9 +154,24 @@ void getNextToken(FILE *file, Token *token) {
             return;
         }
 
+        // Two-character comparison operators
+        if (c == '=' || c == '!' || c == '<' || c == '>') {
+            int next = fgetc(file);
+            if (next == '=') {
+                sprintf(token->text, "%c=", c);
+                token->type = c == '=' ? TOKEN_EQUAL :
+                              c == '!' ? TOKEN_NOT_EQUAL :
+                              c == '<' ? TOKEN_LESS_EQUAL : TOKEN_GREATER_EQUAL;
+                return;
+            }
+            ungetc(next, file);
+        }
+
         // Single-character tokens
         switch (c) {
             case '=': token->type = TOKEN_ASSIGN; strcpy(token->text, "="); return;
+            case '<': token->type = TOKEN_LESS; strcpy(token->text, "<"); return;
+            case '>': token->type = TOKEN_GREATER; strcpy(token->text, ">"); return;
             case '+': token->type = TOKEN_PLUS; strcpy(token->text, "+"); return;
             case '-': token->type = TOKEN_MINUS; strcpy(token->text, "-"); return;
             case '{': token->type = TOKEN_LBRACE; strcpy(token->text, "{"); return;
@@ -99,159 +179,3057 @@ void getNextToken(FILE *file, Token *token) {
             case '(': token->type = TOKEN_LPAREN; strcpy(token->text, "("); return;
             case ')': token->type = TOKEN_RPAREN; strcpy(token->text, ")"); return;
             case ';': token->type = TOKEN_SEMICOLON; strcpy(token->text, ";"); return;
+            case ',': token->type = TOKEN_COMMA; strcpy(token->text, ","); return;
             default: token->type = TOKEN_UNKNOWN; token->text[0] = c; token->text[1] = '\0'; return;
         }
     }
     token->type = TOKEN_EOF;
+    strcpy(token->text, "EOF");
 }
 
 // Parser Functions
 ASTNode *parseExpression();
+ASTNode *parseCondition();
 ASTNode *parseVarDecl();
 ASTNode *parseIf();
+ASTNode *parseWhile();
 ASTNode *parseAssignment();
+ASTNode *parseBlock();
+ASTNode *parseFunction(const char *name, int returns);
+ASTNode *parseVoidFunction();
+ASTNode *parseReturn();
+
+void expect(TokenType type, const char *text) {
+    if (current_token.type != type) {
+        printf("Syntax error: expected '%s' but found '%s'\n", text, current_token.text);
+        fail();
+    }
+    getNextToken(input_file, &current_token);
+}
 
 ASTNode *parseStatement() {
     if (current_token.type == TOKEN_INT) return parseVarDecl();
     else if (current_token.type == TOKEN_IF) return parseIf();
+    else if (current_token.type == TOKEN_WHILE) return parseWhile();
     else if (current_token.type == TOKEN_IDENTIFIER) return parseAssignment();
+    else if (current_token.type == TOKEN_VOID) return parseVoidFunction();
+    else if (current_token.type == TOKEN_RETURN) return parseReturn();
     else {
         printf("Syntax error: unexpected token '%s'\n", current_token.text);
-        exit(1);
+        fail();
     }
 }
 
+// Parse statements up to 'end' and link them through 'next'
+ASTNode *parseStatementList(TokenType end) {
+    ASTNode *head = NULL, **tail = &head;
+    while (current_token.type != end && current_token.type != TOKEN_EOF) {
+        *tail = parseStatement();
+        tail = &(*tail)->next;
+    }
+    return head;
+}
+
+ASTNode *parseProgram() {
+    ASTNode *program = parseStatementList(TOKEN_EOF);
+    expect(TOKEN_EOF, "EOF");
+    return program;
+}
+
+ASTNode *parseBlock() {
+    expect(TOKEN_LBRACE, "{");
+    nesting++;
+    ASTNode *body = parseStatementList(TOKEN_RBRACE);
+    nesting--;
+    expect(TOKEN_RBRACE, "}");
+    return body;
+}
+
 ASTNode *parseVarDecl() {
     getNextToken(input_file, &current_token); // Consume 'int'
     if (current_token.type != TOKEN_IDENTIFIER) {
         printf("Syntax error: expected identifier\n");
-        exit(1);
+        fail();
     }
 
     ASTNode *node = createASTNode(AST_VAR_DECL, current_token.text);
     getNextToken(input_file, &current_token); // Consume identifier
+    if (current_token.type == TOKEN_LPAREN) {
+        ASTNode *function = parseFunction(node->value, 1);
+        free(node);
+        return function;
+    }
+    expect(TOKEN_SEMICOLON, ";");
+
+    return node;
+}
+
+// 'int name(int a, int b) { ... }' or 'void name(...) { ... }', from the
+// opening parenthesis on
+ASTNode *parseFunction(const char *name, int returns) {
+    if (nesting > 0) {
+        printf("Syntax error: function '%s' defined inside a block\n", name);
+        fail();
+    }
+
+    ASTNode *node = createASTNode(AST_FUNCTION, name);
+    ASTNode **tail = &node->left;
+    node->returns = returns;
+
+    expect(TOKEN_LPAREN, "(");
+    while (current_token.type != TOKEN_RPAREN) {
+        if (node->left) expect(TOKEN_COMMA, ",");
+        expect(TOKEN_INT, "int");
+        if (current_token.type != TOKEN_IDENTIFIER) {
+            printf("Syntax error: expected identifier\n");
+            fail();
+        }
+        *tail = createASTNode(AST_VAR_DECL, current_token.text);
+        tail = &(*tail)->next;
+        getNextToken(input_file, &current_token); // Consume identifier
+    }
+    expect(TOKEN_RPAREN, ")");
+
+    node->body = parseBlock();
+    return node;
+}
 
-    if (current_token.type != TOKEN_SEMICOLON) {
-        printf("Syntax error: expected ';'\n");
-        exit(1);
+ASTNode *parseVoidFunction() {
+    getNextToken(input_file, &current_token); // Consume 'void'
+    if (current_token.type != TOKEN_IDENTIFIER) {
+        printf("Syntax error: expected identifier\n");
+        fail();
     }
-    getNextToken(input_file, &current_token); // Consume ';'
 
+    char name[100];
+    strcpy(name, current_token.text);
+    getNextToken(input_file, &current_token); // Consume identifier
+    return parseFunction(name, 0);
+}
+
+ASTNode *parseReturn() {
+    getNextToken(input_file, &current_token); // Consume 'return'
+
+    ASTNode *node = createASTNode(AST_RETURN, NULL);
+    if (current_token.type != TOKEN_SEMICOLON) node->left = parseExpression();
+    expect(TOKEN_SEMICOLON, ";");
+    return node;
+}
+
+// Arguments of a call, from the opening parenthesis on
+ASTNode *parseCall(const char *name) {
+    ASTNode *node = createASTNode(AST_CALL, name);
+    ASTNode **tail = &node->left;
+
+    expect(TOKEN_LPAREN, "(");
+    while (current_token.type != TOKEN_RPAREN) {
+        if (node->left) expect(TOKEN_COMMA, ",");
+        *tail = parseExpression();
+        tail = &(*tail)->next;
+    }
+    expect(TOKEN_RPAREN, ")");
     return node;
 }
 
 ASTNode *parseAssignment() {
-    ASTNode *node = createASTNode(AST_ASSIGN, current_token.text);
+    char name[100];
+    strcpy(name, current_token.text);
     getNextToken(input_file, &current_token); // Consume identifier
 
-    if (current_token.type != TOKEN_ASSIGN) {
-        printf("Syntax error: expected '='\n");
-        exit(1);
+    if (current_token.type == TOKEN_LPAREN) {
+        ASTNode *call = parseCall(name);
+        expect(TOKEN_SEMICOLON, ";");
+        return call;
     }
-    getNextToken(input_file, &current_token); // Consume '='
+
+    ASTNode *node = createASTNode(AST_ASSIGN, name);
+    expect(TOKEN_ASSIGN, "=");
 
     node->left = parseExpression();
-    if (current_token.type != TOKEN_SEMICOLON) {
-        printf("Syntax error: expected ';'\n");
-        exit(1);
+    expect(TOKEN_SEMICOLON, ";");
+    return node;
+}
+
+ASTNode *parsePrimary() {
+    ASTNode *node;
+    if (current_token.type == TOKEN_NUMBER) {
+        node = createASTNode(AST_LITERAL, current_token.text);
+    } else if (current_token.type == TOKEN_IDENTIFIER) {
+        char name[100];
+        strcpy(name, current_token.text);
+        getNextToken(input_file, &current_token); // Consume identifier
+        if (current_token.type == TOKEN_LPAREN) return parseCall(name);
+        return createASTNode(AST_IDENTIFIER, name);
+    } else {
+        printf("Syntax error: expected literal or identifier but found '%s'\n", current_token.text);
+        fail();
     }
-    getNextToken(input_file, &current_token); // Consume ';'
+    getNextToken(input_file, &current_token); // Consume literal or identifier
     return node;
 }
 
+// Additive expressions are left associative: a - b - c == (a - b) - c
 ASTNode *parseExpression() {
-    ASTNode *node = createASTNode(AST_LITERAL, current_token.text);
-    getNextToken(input_file, &current_token); // Consume literal or identifier
+    ASTNode *node = parsePrimary();
 
-    if (current_token.type == TOKEN_PLUS || current_token.type == TOKEN_MINUS) {
+    while (current_token.type == TOKEN_PLUS || current_token.type == TOKEN_MINUS) {
         ASTNode *opNode = createASTNode(AST_BINARY_OP, current_token.text);
         getNextToken(input_file, &current_token); // Consume operator
         opNode->left = node;
-        opNode->right = parseExpression();
-        return opNode;
+        opNode->right = parsePrimary();
+        node = opNode;
     }
 
     return node;
 }
 
+int isComparison(TokenType type) {
+    return type == TOKEN_EQUAL || type == TOKEN_NOT_EQUAL ||
+           type == TOKEN_LESS || type == TOKEN_GREATER ||
+           type == TOKEN_LESS_EQUAL || type == TOKEN_GREATER_EQUAL;
+}
+
+ASTNode *parseCondition() {
+    expect(TOKEN_LPAREN, "(");
+    ASTNode *condition = parseExpression();
+
+    if (isComparison(current_token.type)) {
+        ASTNode *opNode = createASTNode(AST_BINARY_OP, current_token.text);
+        getNextToken(input_file, &current_token); // Consume comparison
+        opNode->left = condition;
+        opNode->right = parseExpression();
+        condition = opNode;
+    }
+
+    expect(TOKEN_RPAREN, ")");
+    return condition;
+}
+
 ASTNode *parseIf() {
     getNextToken(input_file, &current_token); // Consume 'if'
-    if (current_token.type != TOKEN_LPAREN) {
-        printf("Syntax error: expected '('\n");
-        exit(1);
+
+    ASTNode *node = createASTNode(AST_IF, NULL);
+    node->condition = parseCondition();
+    node->body = parseBlock();
+    if (current_token.type == TOKEN_ELSE) {
+        getNextToken(input_file, &current_token); // Consume 'else'
+        node->right = current_token.type == TOKEN_IF ? parseIf() : parseBlock();
+    }
+    return node;
+}
+
+ASTNode *parseWhile() {
+    getNextToken(input_file, &current_token); // Consume 'while'
+
+    ASTNode *node = createASTNode(AST_WHILE, NULL);
+    node->condition = parseCondition();
+    node->body = parseBlock();
+    return node;
+}
+
+// Symbol Table
+//
+// The program and every function have their own variables; a function only
+// sees its parameters and locals.
+int findSymbol(const char *name) {
+    for (int i = 0; i < symbol_count; i++) {
+        if (symbol_scope[i] == current_scope && strcmp(symbols[i], name) == 0) return i;
     }
-    getNextToken(input_file, &current_token); // Consume '('
+    printf("Semantic error: undeclared variable '%s'\n", name);
+    fail();
+}
 
-    ASTNode *condition = parseExpression();
-    if (current_token.type != TOKEN_RPAREN) {
-        printf("Syntax error: expected ')'\n");
-        exit(1);
+int declareSymbol(const char *name) {
+    for (int i = 0; i < symbol_count; i++) {
+        if (symbol_scope[i] == current_scope && strcmp(symbols[i], name) == 0) {
+            printf("Semantic error: redeclaration of '%s'\n", name);
+            fail();
+        }
+    }
+    if (symbol_count == MAX_SYMBOLS) {
+        printf("Semantic error: too many variables\n");
+        fail();
+    }
+    symbol_scope[symbol_count] = current_scope;
+    strcpy(symbols[symbol_count], name);
+    return symbol_count++;
+}
+
+// Functions
+//
+// A function's variables live in .data like the program's, so functions
+// cannot be recursive. Arguments are passed in B to G and the result comes
+// back in A; every register may change across a call.
+typedef struct {
+    ASTNode *node;
+    int params;
+    int first_symbol;            // Parameters, then locals, then the result
+    int result;                  // Symbol holding the return value
+    int calls[MAX_FUNCTIONS];    // Calls the body makes to each function
+    int size;                    // Estimated bytes of code in the body
+    int sites;                   // Calls left once inlined callers are expanded
+    int inlined;
+    int entry;                   // Entry block of the called copy, -1 if none
+    int state;                   // Call graph walks: 1 active, 2 checked, 3 ordered
+} Function;
+
+Function functions[MAX_FUNCTIONS];
+int function_count = 0;
+
+int findFunction(const char *name) {
+    for (int i = 0; i < function_count; i++) {
+        if (strcmp(functions[i].node->value, name) == 0) return i;
     }
-    getNextToken(input_file, &current_token); // Consume ')'
+    printf("Semantic error: undeclared function '%s'\n", name);
+    fail();
+}
 
-    if (current_token.type != TOKEN_LBRACE) {
-        printf("Syntax error: expected '{'\n");
-        exit(1);
+void declareLocals(ASTNode *stmt) {
+    for (; stmt; stmt = stmt->next) {
+        if (stmt->type == AST_VAR_DECL) declareSymbol(stmt->value);
+        declareLocals(stmt->body);
+        declareLocals(stmt->right);
     }
-    getNextToken(input_file, &current_token); // Consume '{'
+}
+
+// Take the function definitions out of the program and declare their
+// variables. Returns what is left of the program.
+ASTNode *collectFunctions(ASTNode *program) {
+    ASTNode **link = &program;
+    while (*link) {
+        ASTNode *node = *link;
+        if (node->type != AST_FUNCTION) {
+            link = &node->next;
+            continue;
+        }
+        *link = node->next;
+
+        if (strcmp(node->value, "out") == 0) {
+            printf("Semantic error: 'out' is built in\n");
+            fail();
+        }
+        for (int i = 0; i < function_count; i++) {
+            if (strcmp(functions[i].node->value, node->value) == 0) {
+                printf("Semantic error: redefinition of '%s'\n", node->value);
+                fail();
+            }
+        }
+        if (function_count == MAX_FUNCTIONS) {
+            printf("Semantic error: too many functions\n");
+            fail();
+        }
 
-    ASTNode *body = parseStatement();
-    if (current_token.type != TOKEN_RBRACE) {
-        printf("Syntax error: expected '}'\n");
-        exit(1);
+        Function *f = &functions[function_count];
+        memset(f, 0, sizeof(Function));
+        f->node = node;
+        f->entry = -1;
+        current_scope = function_count++;
+        f->first_symbol = symbol_count;
+        for (ASTNode *param = node->left; param; param = param->next) {
+            declareSymbol(param->value);
+            f->params++;
+        }
+        if (f->params * int_bytes > MAX_PARAMS) {
+            printf("Semantic error: '%s' has more than %d parameters\n", node->value, MAX_PARAMS / int_bytes);
+            fail();
+        }
+        declareLocals(node->body);
+        f->result = declareSymbol("return");
+        current_scope = -1;
     }
-    getNextToken(input_file, &current_token); // Consume '}'
+    return program;
+}
 
-    ASTNode *node = createASTNode(AST_IF, NULL);
-    node->condition = condition;
-    node->body = body;
-    return node;
+// Add up the calls to each function made by 'node' and the nodes after it
+void countCalls(ASTNode *node, int *counts) {
+    for (; node; node = node->next) {
+        if (node->type == AST_CALL && strcmp(node->value, "out") != 0) counts[findFunction(node->value)]++;
+        countCalls(node->left, counts);
+        countCalls(node->right, counts);
+        countCalls(node->condition, counts);
+        countCalls(node->body, counts);
+    }
 }
 
-// Code Generator
-void generateCode(ASTNode *node) {
-    if (!node) return;
+int hasReturn(ASTNode *stmt) {
+    for (; stmt; stmt = stmt->next) {
+        if (stmt->type == AST_RETURN || hasReturn(stmt->body) || hasReturn(stmt->right)) return 1;
+    }
+    return 0;
+}
 
+// Rough size in bytes of the code for an expression: operands are 2 byte
+// loads, add, sub and cmp take 1 byte, and call 2 plus the argument loads
+int expressionSize(ASTNode *node) {
+    int size = 2;
     switch (node->type) {
-        case AST_VAR_DECL:
-            printf("DECLARE %s\n", node->value);
-            break;
-        case AST_ASSIGN:
-            generateCode(node->left);
-            printf("STORE %s\n", node->value);
-            break;
         case AST_BINARY_OP:
-            generateCode(node->left);
-            generateCode(node->right);
-            if (strcmp(node->value, "+") == 0) printf("ADD\n");
-            else if (strcmp(node->value, "-") == 0) printf("SUB\n");
-            break;
+            return expressionSize(node->left) + expressionSize(node->right) + 1;
+        case AST_CALL:
+            for (ASTNode *arg = node->left; arg; arg = arg->next) {
+                size += expressionSize(arg) + (arg->type != AST_LITERAL && arg->type != AST_IDENTIFIER);
+            }
+            return size;
+        default:
+            return size;
+    }
+}
+
+// Likewise for statements, where stores and jumps take 2 bytes
+int statementsSize(ASTNode *stmt) {
+    int size = 0;
+    for (; stmt; stmt = stmt->next) {
+        switch (stmt->type) {
+            case AST_ASSIGN:
+                size += expressionSize(stmt->left) + 2;
+                break;
+            case AST_RETURN:
+                size += (stmt->left ? expressionSize(stmt->left) : 0) + 2;
+                break;
+            case AST_CALL:
+                size += expressionSize(stmt);
+                break;
+            case AST_IF:
+                size += expressionSize(stmt->condition) + 2 + statementsSize(stmt->body);
+                if (stmt->right) size += 2 + statementsSize(stmt->right);
+                break;
+            case AST_WHILE:
+                size += expressionSize(stmt->condition) + 4 + statementsSize(stmt->body);
+                break;
+            default:
+                break;
+        }
+    }
+    return size;
+}
+
+void checkRecursion(int f) {
+    Function *fn = &functions[f];
+    if (fn->state == 2) return;
+    if (fn->state == 1) {
+        printf("Semantic error: recursive call to '%s'\n", fn->node->value);
+        fail();
+    }
+    fn->state = 1;
+    for (int g = 0; g < function_count; g++) {
+        if (fn->calls[g]) checkRecursion(g);
+    }
+    fn->state = 2;
+}
+
+void callOrder(int f, int *order, int *count) {
+    if (functions[f].state == 3) return;
+    functions[f].state = 3;
+    for (int g = 0; g < function_count; g++) {
+        if (functions[f].calls[g]) callOrder(g, order, count);
+    }
+    order[(*count)++] = f;
+}
+
+// Decide which functions to inline, callers first. Inlining a function
+// copies its body to every call site, in exchange for the call, the ret and
+// the argument moves.
+void planInlining(ASTNode *program) {
+    int program_calls[MAX_FUNCTIONS] = {0}, order[MAX_FUNCTIONS], count = 0;
+
+    countCalls(program, program_calls);
+    for (int f = 0; f < function_count; f++) {
+        countCalls(functions[f].node->body, functions[f].calls);
+        functions[f].size = statementsSize(functions[f].node->body) * int_bytes;
+    }
+    for (int f = 0; f < function_count; f++) checkRecursion(f);
+    for (int f = 0; f < function_count; f++) {
+        if (program_calls[f]) callOrder(f, order, &count);
+    }
+
+    for (int i = count - 1; i >= 0; i--) {
+        Function *fn = &functions[order[i]];
+        fn->sites = program_calls[order[i]];
+        for (int c = 0; c < function_count; c++) {
+            Function *caller = &functions[c];
+            if (caller->sites > 0) fn->sites += caller->calls[order[i]] * (caller->inlined ? caller->sites : 1);
+        }
+
+        // Every byte of a wide int is moved on its own
+        int p = fn->params * int_bytes;
+        int growth = fn->sites * fn->size - (fn->size + 1 + 2 * p + fn->sites * (2 + 2 * p));
+        int saved = fn->sites * (CALL_CYCLES + ARGUMENT_CYCLES * p);
+        fn->inlined = optimize && inline_calls && growth * INLINE_CYCLES_PER_BYTE <= saved;
+    }
+}
+
+// Intermediate Representation
+//
+// Three-address code in SSA form. Every instruction defines at most one
+// value, identified by the instruction index. Instructions live in basic
+// blocks that end with a jump, a branch, a halt or a ret. The program's
+// blocks come first, then those of each function that is called.
+
+typedef enum {
+    IR_CONST,     // dest = constant
+    IR_COPY,      // dest = args[0]
+    IR_ADD,       // dest = args[0] + args[1]
+    IR_SUB,       // dest = args[0] - args[1]
+    IR_PARAM,     // dest = argument 'constant', passed in registers from B + constant * int_bytes
+    IR_CALL,      // dest = function 'constant' called with args
+    IR_PHI,       // dest = args[i] when entered from predecessor i
+    IR_OUT,       // out args[0]
+    IR_JUMP,      // goto targets[0]
+    IR_BRANCH,    // if (args[0] compare args[1]) goto targets[0] else targets[1]
+    IR_HALT,
+    IR_RET        // return args[0], if any
+} IROpcode;
+
+typedef struct {
+    IROpcode op;
+    int constant;
+    int *args;
+    int arg_count;
+    char compare[3];
+    int targets[2];
+    int block;         // Containing block, -1 once the instruction is deleted
+    int replacement;   // Value that replaced this one, -1 if none
+    int variable;      // Source variable, -1 for temporaries
+} IRInstr;
+
+typedef struct {
+    int *instrs;
+    int instr_count, instr_capacity;
+    int *preds;
+    int pred_count, pred_capacity;
+    int defs[MAX_SYMBOLS];        // Current value of every variable, -1 if not yet known
+    int incomplete[MAX_SYMBOLS];  // Phis created before the block was sealed
+    int sealed;
+    int removed;
+    int idom;
+    const char *label;            // Function name on a function's entry block
+} IRBlock;
+
+// Blocks first..last form the loop; the preheader jumps to its condition
+typedef struct {
+    int preheader;
+    int first;
+    int last;
+} IRLoop;
+
+IRInstr *ir = NULL;
+int ir_count = 0, ir_capacity = 0;
+IRBlock *blocks = NULL;
+int block_count = 0, block_capacity = 0;
+int *layout = NULL;
+int layout_count = 0;
+IRLoop loops[MAX_LOOPS];
+int loop_count = 0;
+int current_block;
+int return_block = -1;   // Where 'return' goes in the function being built
+
+void *growArray(void *array, int *capacity, int count, size_t size) {
+    if (count < *capacity) return array;
+    *capacity = *capacity ? *capacity * 2 : 8;
+    return realloc(array, *capacity * size);
+}
+
+int resolve(int value) {
+    while (ir[value].replacement >= 0) value = ir[value].replacement;
+    return value;
+}
+
+int isConstant(int value) {
+    return ir[resolve(value)].op == IR_CONST;
+}
+
+int newBlock() {
+    blocks = growArray(blocks, &block_capacity, block_count, sizeof(IRBlock));
+    IRBlock *block = &blocks[block_count];
+    memset(block, 0, sizeof(IRBlock));
+    memset(block->defs, -1, sizeof(block->defs));
+    memset(block->incomplete, -1, sizeof(block->incomplete));
+    block->idom = -1;
+    return block_count++;
+}
+
+// Start filling a block; blocks are laid out in the order they are started
+void startBlock(int block) {
+    layout = realloc(layout, (layout_count + 1) * sizeof(int));
+    layout[layout_count++] = block;
+    current_block = block;
+}
+
+// A loop body is given its back edge before the branch that makes it, so
+// the same edge may be added twice
+void addPred(int block, int pred) {
+    IRBlock *b = &blocks[block];
+    for (int i = 0; i < b->pred_count; i++) {
+        if (b->preds[i] == pred) return;
+    }
+    b->preds = growArray(b->preds, &b->pred_capacity, b->pred_count, sizeof(int));
+    b->preds[b->pred_count++] = pred;
+}
+
+int newInstr(IROpcode op, int block, int at_start) {
+    ir = growArray(ir, &ir_capacity, ir_count, sizeof(IRInstr));
+    IRInstr *instr = &ir[ir_count];
+    memset(instr, 0, sizeof(IRInstr));
+    instr->op = op;
+    instr->block = block;
+    instr->replacement = -1;
+    instr->variable = -1;
+    instr->args = malloc(2 * sizeof(int));
+
+    IRBlock *b = &blocks[block];
+    b->instrs = growArray(b->instrs, &b->instr_capacity, b->instr_count, sizeof(int));
+    if (at_start) {
+        memmove(b->instrs + 1, b->instrs, b->instr_count * sizeof(int));
+        b->instrs[0] = ir_count;
+    } else {
+        b->instrs[b->instr_count] = ir_count;
+    }
+    b->instr_count++;
+    return ir_count++;
+}
+
+// Wrap a number to the width of int. Constants keep the bit pattern, so a
+// 32-bit one may come out negative; compare them with compareValues.
+int wrap(long long value) {
+    return (int)((unsigned)value & int_mask);
+}
+
+int literal(const char *text) {
+    return wrap(strtoll(text, NULL, 10));
+}
+
+int emitConst(int value) {
+    int id = newInstr(IR_CONST, current_block, 0);
+    ir[id].constant = wrap(value);
+    return id;
+}
+
+int emitBinary(IROpcode op, int a, int b) {
+    int id = newInstr(op, current_block, 0);
+    ir[id].args[0] = a;
+    ir[id].args[1] = b;
+    ir[id].arg_count = 2;
+    return id;
+}
+
+void emitJump(int target) {
+    int id = newInstr(IR_JUMP, current_block, 0);
+    ir[id].targets[0] = target;
+    addPred(target, current_block);
+}
+
+void emitBranch(const char *compare, int a, int b, int if_true, int if_false) {
+    int id = emitBinary(IR_BRANCH, a, b);
+    strcpy(ir[id].compare, compare);
+    ir[id].targets[0] = if_true;
+    ir[id].targets[1] = if_false;
+    addPred(if_true, current_block);
+    addPred(if_false, current_block);
+}
+
+// SSA construction on the fly (Braun et al., "Simple and Efficient
+// Construction of Static Single Assignment Form"). A block is sealed once
+// all of its predecessors are known.
+int readVariable(int variable, int block);
+
+void addPhiOperands(int variable, int phi) {
+    IRBlock *b = &blocks[ir[phi].block];
+    ir[phi].args = realloc(ir[phi].args, (b->pred_count + 2) * sizeof(int));
+    for (int i = 0; i < b->pred_count; i++) {
+        int value = readVariable(variable, b->preds[i]);
+        ir[phi].args[i] = value;
+    }
+    ir[phi].arg_count = b->pred_count;
+}
+
+int newPhi(int variable, int block) {
+    int phi = newInstr(IR_PHI, block, 1);
+    ir[phi].variable = variable;
+    return phi;
+}
+
+int readVariable(int variable, int block) {
+    IRBlock *b = &blocks[block];
+    int value;
+
+    if (b->defs[variable] >= 0) return b->defs[variable];
+
+    if (!b->sealed) {
+        value = newPhi(variable, block);
+        b->incomplete[variable] = value;
+    } else if (b->pred_count == 0) {
+        // Reading a variable before any assignment: .data starts zeroed
+        value = newInstr(IR_CONST, block, 1);
+        ir[value].constant = 0;
+    } else if (b->pred_count == 1) {
+        value = readVariable(variable, b->preds[0]);
+    } else {
+        value = newPhi(variable, block);
+        b->defs[variable] = value;
+        addPhiOperands(variable, value);
+    }
+
+    blocks[block].defs[variable] = value;
+    return value;
+}
+
+void sealBlock(int block) {
+    for (int v = 0; v < symbol_count; v++) {
+        if (blocks[block].incomplete[v] >= 0) addPhiOperands(v, blocks[block].incomplete[v]);
+    }
+    blocks[block].sealed = 1;
+}
+
+// IR Construction
+void buildStatements(ASTNode *stmt);
+
+int isArithmetic(ASTNode *node) {
+    return node->type == AST_BINARY_OP &&
+           (strcmp(node->value, "+") == 0 || strcmp(node->value, "-") == 0);
+}
+
+int buildCall(ASTNode *node);
+
+int buildExpression(ASTNode *node) {
+    switch (node->type) {
         case AST_LITERAL:
-            printf("LOAD %s\n", node->value);
-            break;
-        case AST_IF:
-            generateCode(node->condition);
-            printf("JUMP_IF_ZERO else_label\n");
-            generateCode(node->body);
-            printf("else_label:\n");
-            break;
+            return emitConst(literal(node->value));
+        case AST_IDENTIFIER:
+            return readVariable(findSymbol(node->value), current_block);
+        case AST_BINARY_OP: {
+            int a = buildExpression(node->left);
+            int b = buildExpression(node->right);
+            return emitBinary(strcmp(node->value, "+") == 0 ? IR_ADD : IR_SUB, a, b);
+        }
+        case AST_CALL: {
+            int value = buildCall(node);
+            if (value < 0) {
+                printf("Semantic error: '%s' does not return a value\n", node->value);
+                fail();
+            }
+            return value;
+        }
         default:
-            printf("Unknown AST node type\n");
+            printf("Unknown expression node type\n");
+            fail();
     }
 }
 
-// Main Function
-int main() {
-    input_file = fopen("input.txt", "r");
-    if (!input_file) {
-        perror("Failed to open input file");
-        return 1;
+void buildBranch(ASTNode *condition, int if_true, int if_false) {
+    if (condition->type == AST_BINARY_OP && !isArithmetic(condition)) {
+        int a = buildExpression(condition->left);
+        int b = buildExpression(condition->right);
+        emitBranch(condition->value, a, b, if_true, if_false);
+    } else {
+        int a = buildExpression(condition);
+        emitBranch("!=", a, emitConst(0), if_true, if_false);
     }
+}
 
-    getNextToken(input_file, &current_token);
+// Follow copies and constant arithmetic down to a known constant
+int constantValue(int value, int *result) {
+    int a, b;
+    value = resolve(value);
+    switch (ir[value].op) {
+        case IR_CONST:
+            *result = ir[value].constant;
+            return 1;
+        case IR_COPY:
+            return constantValue(ir[value].args[0], result);
+        case IR_ADD:
+        case IR_SUB:
+            if (!constantValue(ir[value].args[0], &a) || !constantValue(ir[value].args[1], &b)) return 0;
+            *result = wrap(ir[value].op == IR_ADD ? (long long)a + b : (long long)a - b);
+            return 1;
+        case IR_PHI: {
+            // Every way in brings the same constant (or the phi itself)
+            int found = 0;
+            for (int i = 0; i < ir[value].arg_count; i++) {
+                int arg = resolve(ir[value].args[i]);
+                if (arg == value) continue;
+                if (ir[arg].op != IR_CONST || (found && ir[arg].constant != *result)) return 0;
+                *result = ir[arg].constant;
+                found = 1;
+            }
+            return found;
+        }
+        default:
+            return 0;
+    }
+}
+
+// Evaluate a comparison on unsigned values, the way cmp sets the flags
+int compareValues(const char *op, int x, int y) {
+    unsigned a = x, b = y;
+    if (strcmp(op, "==") == 0) return a == b;
+    if (strcmp(op, "!=") == 0) return a != b;
+    if (strcmp(op, "<") == 0) return a < b;
+    if (strcmp(op, ">") == 0) return a > b;
+    if (strcmp(op, "<=") == 0) return a <= b;
+    return a >= b;
+}
+
+int isAssignedIn(ASTNode *stmt, const char *name) {
+    for (; stmt; stmt = stmt->next) {
+        if (stmt->type == AST_ASSIGN && strcmp(stmt->value, name) == 0) return 1;
+        if (isAssignedIn(stmt->body, name) || isAssignedIn(stmt->right, name)) return 1;
+    }
+    return 0;
+}
+
+int countStatements(ASTNode *stmt) {
+    int count = 0;
+    for (; stmt; stmt = stmt->next) count += 1 + countStatements(stmt->body) + countStatements(stmt->right);
+    return count;
+}
+
+// Number of iterations of 'while (i op K) { ... i = i +/- c; ... }' when i
+// and K are known on entry and i is updated exactly once at the top level
+// of the body. Returns -1 if the loop does not have that shape or runs too
+// long to be worth unrolling.
+int tripCount(ASTNode *node) {
+    ASTNode *cond = node->condition;
+    ASTNode *step = NULL;
+    int value, bound, trips = 0;
+
+    if (cond->type != AST_BINARY_OP || isArithmetic(cond)) return -1;
+    if (cond->left->type != AST_IDENTIFIER) return -1;
+    if (cond->right->type == AST_IDENTIFIER) {
+        if (isAssignedIn(node->body, cond->right->value)) return -1;
+        if (!constantValue(readVariable(findSymbol(cond->right->value), current_block), &bound)) return -1;
+    } else if (cond->right->type == AST_LITERAL) {
+        bound = literal(cond->right->value);
+    } else {
+        return -1;
+    }
+
+    const char *iv = cond->left->value;
+    if (!constantValue(readVariable(findSymbol(iv), current_block), &value)) return -1;
+
+    for (ASTNode *stmt = node->body; stmt; stmt = stmt->next) {
+        if (stmt->type == AST_ASSIGN && strcmp(stmt->value, iv) == 0) {
+            if (step) return -1;
+            step = stmt;
+        } else if (isAssignedIn(stmt->body, iv) || isAssignedIn(stmt->right, iv)) {
+            return -1;
+        }
+    }
+    if (!step || !isArithmetic(step->left) || step->left->left->type != AST_IDENTIFIER ||
+        strcmp(step->left->left->value, iv) != 0 || step->left->right->type != AST_LITERAL) {
+        return -1;
+    }
+
+    int delta = literal(step->left->right->value);
+    if (strcmp(step->left->value, "-") == 0) delta = wrap(-(long long)delta);
+
+    while (compareValues(cond->value, value, bound)) {
+        if (++trips > MAX_UNROLL_TRIPS) return -1;
+        value = wrap((long long)value + delta);
+    }
+    if (trips * countStatements(node->body) > MAX_UNROLL_STATEMENTS) return -1;
+    return trips;
+}
+
+int endsInReturn(ASTNode *stmt) {
+    while (stmt && stmt->next) stmt = stmt->next;
+    return stmt && stmt->type == AST_RETURN;
+}
+
+// Of the two arms of an if/else, the one laid out second falls through to
+// the join and the first one jumps over it, so the likely arm goes second.
+// An arm ending in return jumps away anyway and goes first; otherwise an
+// equality test is taken to be false more often than not (Ball and Larus,
+// "Branch Prediction for Free").
+int elseFirst(ASTNode *node) {
+    if (endsInReturn(node->body)) return 0;
+    if (endsInReturn(node->right)) return 1;
+    return node->condition->type == AST_BINARY_OP && strcmp(node->condition->value, "!=") == 0;
+}
+
+void buildArm(int block, ASTNode *body, int join_block) {
+    startBlock(block);
+    buildStatements(body);
+    emitJump(join_block);
+}
+
+void buildIf(ASTNode *node) {
+    int then_block = newBlock();
+    int else_block = node->right ? newBlock() : -1;
+    int join_block = newBlock();
+
+    buildBranch(node->condition, then_block, node->right ? else_block : join_block);
+    sealBlock(then_block);
+
+    if (!node->right) {
+        buildArm(then_block, node->body, join_block);
+    } else if (elseFirst(node)) {
+        sealBlock(else_block);
+        buildArm(else_block, node->right, join_block);
+        buildArm(then_block, node->body, join_block);
+    } else {
+        sealBlock(else_block);
+        buildArm(then_block, node->body, join_block);
+        buildArm(else_block, node->right, join_block);
+    }
+
+    sealBlock(join_block);
+    startBlock(join_block);
+}
+
+// Loops are rotated: the preheader jumps to the test, which sits after the
+// body, so every iteration runs a single conditional branch.
+void buildWhile(ASTNode *node) {
+    int trips = optimize ? tripCount(node) : -1;
+    if (trips >= 0) {
+        for (int i = 0; i < trips; i++) buildStatements(node->body);
+        return;
+    }
+
+    int preheader = current_block;
+    int body_block = newBlock();
+    int cond_block = newBlock();
+
+    emitJump(cond_block);
+    addPred(body_block, cond_block);
+    sealBlock(body_block);
+
+    startBlock(body_block);
+    buildStatements(node->body);
+    emitJump(cond_block);
+
+    sealBlock(cond_block);
+    startBlock(cond_block);
+    int last_block = block_count - 1;
+    int exit_block = newBlock();
+    buildBranch(node->condition, body_block, exit_block);
+    sealBlock(exit_block);
+    startBlock(exit_block);
+
+    if (loop_count < MAX_LOOPS) {
+        loops[loop_count].preheader = preheader;
+        loops[loop_count].first = body_block;
+        loops[loop_count].last = last_block;
+        loop_count++;
+    }
+}
+
+void buildAssignment(int variable, ASTNode *expression) {
+    int first = ir_count;
+    int value = buildExpression(expression);
+    if (value < first) {
+        // Plain variable read: keep the copy visible in the IR
+        value = emitBinary(IR_COPY, value, value);
+        ir[value].arg_count = 1;
+    }
+    ir[value].variable = variable;
+    blocks[current_block].defs[variable] = value;
+}
+
+void buildReturn(ASTNode *node) {
+    if (current_scope < 0) {
+        printf("Semantic error: return outside a function\n");
+        fail();
+    }
+    Function *fn = &functions[current_scope];
+    if (!node->left != !fn->node->returns) {
+        printf("Semantic error: '%s' %s\n", fn->node->value,
+               fn->node->returns ? "must return a value" : "does not return a value");
+        fail();
+    }
+
+    if (node->left) buildAssignment(fn->result, node->left);
+    emitJump(return_block);
+
+    // Anything after the return is unreachable
+    startBlock(newBlock());
+    sealBlock(current_block);
+}
+
+// Body of the function being built, then the block every return joins in.
+// Returns the result.
+int buildBody(Function *fn) {
+    return_block = hasReturn(fn->node->body) ? newBlock() : -1;
+    buildStatements(fn->node->body);
+    if (return_block >= 0) {
+        emitJump(return_block);
+        sealBlock(return_block);
+        startBlock(return_block);
+    }
+    return readVariable(fn->result, current_block);
+}
+
+// The body of function f copied to the call site, with its parameters
+// bound to the arguments and its other variables starting at 0
+int inlineCall(int f, int *args) {
+    Function *fn = &functions[f];
+    int scope = current_scope, saved_return = return_block;
+    int zero = emitConst(0);
+
+    for (int v = fn->first_symbol; v <= fn->result; v++) blocks[current_block].defs[v] = zero;
+    for (int i = 0; i < fn->params; i++) blocks[current_block].defs[fn->first_symbol + i] = args[i];
+
+    current_scope = f;
+    int value = buildBody(fn);
+    current_scope = scope;
+    return_block = saved_return;
+    return value;
+}
+
+// Returns the value of the call, -1 if there is none
+int buildCall(ASTNode *node) {
+    int args[MAX_PARAMS], count = 0;
+    for (ASTNode *arg = node->left; arg; arg = arg->next) {
+        if (count == MAX_PARAMS) {
+            printf("Semantic error: too many arguments to '%s'\n", node->value);
+            fail();
+        }
+        args[count++] = buildExpression(arg);
+    }
+
+    if (strcmp(node->value, "out") == 0) {
+        if (count != 1) {
+            printf("Semantic error: 'out' takes 1 argument\n");
+            fail();
+        }
+        int id = newInstr(IR_OUT, current_block, 0);
+        ir[id].args[0] = args[0];
+        ir[id].arg_count = 1;
+        return -1;
+    }
+
+    int f = findFunction(node->value);
+    Function *fn = &functions[f];
+    if (count != fn->params) {
+        printf("Semantic error: '%s' takes %d argument%s\n", node->value, fn->params, fn->params == 1 ? "" : "s");
+        fail();
+    }
+    if (fn->inlined) {
+        int value = inlineCall(f, args);
+        return fn->node->returns ? value : -1;
+    }
+
+    int id = newInstr(IR_CALL, current_block, 0);
+    ir[id].args = realloc(ir[id].args, MAX_PARAMS * sizeof(int));
+    memcpy(ir[id].args, args, count * sizeof(int));
+    ir[id].arg_count = count;
+    ir[id].constant = f;
+    return fn->node->returns ? id : -1;
+}
+
+void buildStatements(ASTNode *stmt) {
+    for (; stmt; stmt = stmt->next) {
+        switch (stmt->type) {
+            case AST_VAR_DECL:
+                // Function variables are declared up front
+                if (current_scope < 0) declareSymbol(stmt->value);
+                break;
+            case AST_ASSIGN:
+                buildAssignment(findSymbol(stmt->value), stmt->left);
+                break;
+            case AST_IF:
+                buildIf(stmt);
+                break;
+            case AST_WHILE:
+                buildWhile(stmt);
+                break;
+            case AST_CALL:
+                buildCall(stmt);
+                break;
+            case AST_RETURN:
+                buildReturn(stmt);
+                break;
+            default:
+                printf("Unknown AST node type\n");
+                fail();
+        }
+    }
+}
+
+// A function that is called, rather than inlined, takes its arguments from
+// B to G on entry
+void buildFunction(int f) {
+    Function *fn = &functions[f];
+    current_scope = f;
+    fn->entry = newBlock();
+    blocks[fn->entry].label = fn->node->value;
+    startBlock(fn->entry);
+    sealBlock(fn->entry);
+
+    for (int i = 0; i < fn->params; i++) {
+        int id = newInstr(IR_PARAM, current_block, 0);
+        ir[id].constant = i;
+        ir[id].variable = fn->first_symbol + i;
+        blocks[current_block].defs[fn->first_symbol + i] = id;
+    }
+
+    int value = buildBody(fn);
+    int id = newInstr(IR_RET, current_block, 0);
+    if (fn->node->returns) {
+        ir[id].args[0] = value;
+        ir[id].arg_count = 1;
+    }
+    return_block = -1;
+    current_scope = -1;
+}
+
+// Every variable of the program is printed with 'out 0' before halting
+void buildProgram(ASTNode *program) {
+    program = collectFunctions(program);
+    planInlining(program);
+
+    startBlock(newBlock());
+    sealBlock(current_block);
+    buildStatements(program);
+
+    for (int v = 0; v < symbol_count; v++) {
+        if (symbol_scope[v] >= 0) continue;
+        int value = readVariable(v, current_block);
+        int id = newInstr(IR_OUT, current_block, 0);
+        ir[id].args[0] = value;
+        ir[id].arg_count = 1;
+    }
+    newInstr(IR_HALT, current_block, 0);
+
+    for (int f = 0; f < function_count; f++) {
+        if (functions[f].sites > 0 && !functions[f].inlined) buildFunction(f);
+    }
+}
+
+// IR Utilities
+int isLive(int id, int block) {
+    return ir[id].block == block;
+}
+
+int terminator(int block) {
+    IRBlock *b = &blocks[block];
+    for (int i = b->instr_count - 1; i >= 0; i--) {
+        if (isLive(b->instrs[i], block)) return b->instrs[i];
+    }
+    return -1;
+}
+
+int successorCount(int block) {
+    IROpcode op = ir[terminator(block)].op;
+    return op == IR_BRANCH ? 2 : op == IR_JUMP ? 1 : 0;
+}
+
+int successor(int block, int i) {
+    return ir[terminator(block)].targets[i];
+}
+
+void deleteInstr(int id) {
+    ir[id].block = -1;
+}
+
+void replaceValue(int id, int value) {
+    ir[id].replacement = value;
+    deleteInstr(id);
+}
+
+// Drop the edge from -> to, along with the matching phi operands
+void removeEdge(int from, int to) {
+    IRBlock *b = &blocks[to];
+    int index = -1;
+    for (int i = 0; i < b->pred_count; i++) {
+        if (b->preds[i] == from) index = i;
+    }
+    if (index < 0) return;
+
+    for (int i = index; i + 1 < b->pred_count; i++) b->preds[i] = b->preds[i + 1];
+    b->pred_count--;
+
+    for (int i = 0; i < b->instr_count; i++) {
+        int id = b->instrs[i];
+        if (!isLive(id, to) || ir[id].op != IR_PHI) continue;
+        for (int j = index; j + 1 < ir[id].arg_count; j++) ir[id].args[j] = ir[id].args[j + 1];
+        ir[id].arg_count--;
+    }
+}
+
+// Optimization Passes
+
+// Copies and phis whose operands are all the same value are replaced by
+// that value
+int propagateCopies() {
+    int changed = 0;
+    for (int id = 0; id < ir_count; id++) {
+        if (ir[id].block < 0) continue;
+
+        if (ir[id].op == IR_COPY) {
+            replaceValue(id, resolve(ir[id].args[0]));
+            changed = 1;
+        } else if (ir[id].op == IR_PHI) {
+            int same = -1, trivial = 1;
+            for (int i = 0; i < ir[id].arg_count; i++) {
+                int arg = resolve(ir[id].args[i]);
+                if (arg == id || arg == same) continue;
+                if (same >= 0) trivial = 0;
+                same = arg;
+            }
+            if (trivial && same >= 0) {
+                replaceValue(id, same);
+                changed = 1;
+            }
+        }
+    }
+    return changed;
+}
+
+// Fold arithmetic on constants, x + 0 and x - 0, and branches whose outcome
+// is known
+int countUses(int value) {
+    int uses = 0;
+    for (int id = 0; id < ir_count; id++) {
+        if (ir[id].block < 0) continue;
+        for (int i = 0; i < ir[id].arg_count; i++) uses += resolve(ir[id].args[i]) == value;
+    }
+    return uses;
+}
+
+// (x + c1) + c2 becomes x + (c1 + c2), and likewise for subtraction. Only
+// done when nothing else reads x + c1, which would keep x alive for longer.
+int reassociate(int id, int b) {
+    int inner = resolve(ir[id].args[0]), c;
+    if ((ir[inner].op != IR_ADD && ir[inner].op != IR_SUB) || isConstant(ir[inner].args[0]) ||
+        !constantValue(ir[inner].args[1], &c) || countUses(inner) != 1) {
+        return 0;
+    }
+
+    // Keep the constant at most half the range, subtracting rather than adding
+    unsigned delta = wrap((ir[inner].op == IR_ADD ? (long long)c : -(long long)c) +
+                          (ir[id].op == IR_ADD ? (long long)b : -(long long)b));
+    unsigned half = int_mask / 2 + 1;
+    int constant = newInstr(IR_CONST, ir[id].block, 1);
+    ir[constant].constant = delta > half ? wrap(-(long long)delta) : (int)delta;
+    ir[id].op = delta > half ? IR_SUB : IR_ADD;
+    ir[id].args[0] = ir[inner].args[0];
+    ir[id].args[1] = constant;
+    return 1;
+}
+
+int foldConstants() {
+    int changed = 0, a, b;
+    for (int id = 0; id < ir_count; id++) {
+        IRInstr *instr = &ir[id];
+        if (instr->block < 0) continue;
+
+        if (instr->op == IR_ADD || instr->op == IR_SUB) {
+            int known_a = constantValue(instr->args[0], &a);
+            int known_b = constantValue(instr->args[1], &b);
+            if (known_a && known_b) {
+                instr->constant = wrap(instr->op == IR_ADD ? (long long)a + b : (long long)a - b);
+                instr->op = IR_CONST;
+                instr->arg_count = 0;
+                changed = 1;
+            } else if (known_b && b == 0) {
+                replaceValue(id, resolve(instr->args[0]));
+                changed = 1;
+            } else if (known_a && a == 0 && instr->op == IR_ADD) {
+                replaceValue(id, resolve(instr->args[1]));
+                changed = 1;
+            } else if (known_b) {
+                changed |= reassociate(id, b);
+            }
+        } else if (instr->op == IR_BRANCH &&
+                   constantValue(instr->args[0], &a) && constantValue(instr->args[1], &b)) {
+            int taken = compareValues(instr->compare, a, b) ? 0 : 1;
+            int target = instr->targets[taken];
+            int other = instr->targets[1 - taken];
+            instr->op = IR_JUMP;
+            instr->targets[0] = target;
+            instr->arg_count = 0;
+            if (other != target) removeEdge(instr->block, other);
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+// The program's entry block or a function's
+int isEntry(int block) {
+    return block == 0 || blocks[block].label != NULL;
+}
+
+int reachable(int block, char *seen) {
+    if (seen[block]) return 0;
+    seen[block] = 1;
+    for (int i = 0; i < successorCount(block); i++) reachable(successor(block, i), seen);
+    return 0;
+}
+
+int removeUnreachableBlocks() {
+    int changed = 0;
+    char *seen = calloc(block_count, 1);
+    for (int block = 0; block < block_count; block++) {
+        if (isEntry(block)) reachable(block, seen);
+    }
+
+    for (int block = 0; block < block_count; block++) {
+        IRBlock *b = &blocks[block];
+        if (seen[block] || b->removed) continue;
+        for (int i = 0; i < successorCount(block); i++) removeEdge(block, successor(block, i));
+        for (int i = 0; i < b->instr_count; i++) {
+            if (isLive(b->instrs[i], block)) deleteInstr(b->instrs[i]);
+        }
+        b->removed = 1;
+        changed = 1;
+    }
+
+    free(seen);
+    return changed;
+}
+
+// Immediate dominators (Cooper, Harvey and Kennedy) over reverse postorder
+void postorder(int block, char *seen, int *order, int *count) {
+    seen[block] = 1;
+    for (int i = 0; i < successorCount(block); i++) {
+        if (!seen[successor(block, i)]) postorder(successor(block, i), seen, order, count);
+    }
+    order[(*count)++] = block;
+}
+
+void computeDominators(int *rpo, int *count) {
+    char *seen = calloc(block_count, 1);
+    int *order = malloc(block_count * sizeof(int));
+    int *index = malloc(block_count * sizeof(int));
+    *count = 0;
+    for (int i = 0; i < block_count; i++) blocks[i].idom = -1;
+    for (int block = 0; block < block_count; block++) {
+        if (isEntry(block) && !blocks[block].removed) {
+            postorder(block, seen, order, count);
+            blocks[block].idom = block;
+        }
+    }
+    for (int i = 0; i < *count; i++) {
+        rpo[i] = order[*count - 1 - i];
+        index[rpo[i]] = i;
+    }
+
+    // Each entry block roots its own tree
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (int i = 0; i < *count; i++) {
+            if (isEntry(rpo[i])) continue;
+            IRBlock *b = &blocks[rpo[i]];
+            int idom = -1;
+            for (int p = 0; p < b->pred_count; p++) {
+                int pred = b->preds[p];
+                if (blocks[pred].idom < 0) continue;
+                if (idom < 0) {
+                    idom = pred;
+                    continue;
+                }
+                int x = pred, y = idom;
+                while (x != y) {
+                    while (index[x] > index[y]) x = blocks[x].idom;
+                    while (index[y] > index[x]) y = blocks[y].idom;
+                }
+                idom = x;
+            }
+            if (b->idom != idom) {
+                b->idom = idom;
+                changed = 1;
+            }
+        }
+    }
+
+    free(seen);
+    free(order);
+    free(index);
+}
+
+int dominates(int a, int b) {
+    while (b != a && !isEntry(b)) b = blocks[b].idom;
+    return a == b;
+}
+
+int sameExpression(int x, int y) {
+    int xa = resolve(ir[x].args[0]), xb = resolve(ir[x].args[1]);
+    int ya = resolve(ir[y].args[0]), yb = resolve(ir[y].args[1]);
+    if (ir[x].op != ir[y].op) return 0;
+    if (xa == ya && xb == yb) return 1;
+    return ir[x].op == IR_ADD && xa == yb && xb == ya;
+}
+
+// An add or sub is replaced by an identical one in a dominating position
+int eliminateCommonSubexpressions() {
+    int changed = 0, count;
+    int *rpo = malloc(block_count * sizeof(int));
+    int *available = malloc(ir_count * sizeof(int));
+    int available_count = 0;
+
+    computeDominators(rpo, &count);
+
+    // In reverse postorder every dominator is visited before the blocks it
+    // dominates, so checking dominance of earlier candidates is enough
+    for (int i = 0; i < count; i++) {
+        IRBlock *b = &blocks[rpo[i]];
+        for (int j = 0; j < b->instr_count; j++) {
+            int id = b->instrs[j];
+            if (!isLive(id, rpo[i]) || (ir[id].op != IR_ADD && ir[id].op != IR_SUB)) continue;
+
+            int match = -1;
+            for (int k = 0; k < available_count && match < 0; k++) {
+                int other = available[k];
+                if (ir[other].block >= 0 && dominates(ir[other].block, rpo[i]) && sameExpression(other, id)) {
+                    match = other;
+                }
+            }
+            if (match >= 0) {
+                replaceValue(id, match);
+                changed = 1;
+            } else {
+                available[available_count++] = id;
+            }
+        }
+    }
+
+    free(rpo);
+    free(available);
+    return changed;
+}
+
+int inLoop(IRLoop *loop, int block) {
+    return block >= loop->first && block <= loop->last;
+}
+
+void moveBeforeTerminator(int id, int block) {
+    IRBlock *b = &blocks[block];
+    int term = terminator(block);
+    b->instrs = growArray(b->instrs, &b->instr_capacity, b->instr_count, sizeof(int));
+    for (int i = b->instr_count - 1; i >= 0; i--) {
+        if (b->instrs[i] == term) {
+            memmove(b->instrs + i + 1, b->instrs + i, (b->instr_count - i) * sizeof(int));
+            b->instrs[i] = id;
+            break;
+        }
+    }
+    b->instr_count++;
+    ir[id].block = block;
+}
+
+// Arithmetic whose operands are all defined outside a loop moves to the
+// loop preheader. It is pure, so running it when the loop body does not
+// execute is harmless.
+int hoistLoopInvariants() {
+    int changed = 0;
+    for (int l = 0; l < loop_count; l++) {
+        IRLoop *loop = &loops[l];
+        if (blocks[loop->preheader].removed) continue;
+
+        for (int moved = 1; moved;) {
+            moved = 0;
+            for (int block = loop->first; block <= loop->last; block++) {
+                IRBlock *b = &blocks[block];
+                if (b->removed) continue;
+                for (int j = 0; j < b->instr_count; j++) {
+                    int id = b->instrs[j];
+                    if (!isLive(id, block) || (ir[id].op != IR_ADD && ir[id].op != IR_SUB)) continue;
+                    int a = resolve(ir[id].args[0]), c = resolve(ir[id].args[1]);
+                    if (!isConstant(a) && inLoop(loop, ir[a].block)) continue;
+                    if (!isConstant(c) && inLoop(loop, ir[c].block)) continue;
+                    moveBeforeTerminator(id, loop->preheader);
+                    moved = changed = 1;
+                }
+            }
+        }
+    }
+    return changed;
+}
+
+// A value that is never used is a store nobody reads: drop it
+int eliminateDeadStores() {
+    int changed = 0;
+    char *used = calloc(ir_count, 1);
+    int *worklist = malloc(ir_count * sizeof(int));
+    int count = 0;
+
+    for (int id = 0; id < ir_count; id++) {
+        IROpcode op = ir[id].op;
+        if (ir[id].block >= 0 && (op == IR_OUT || op == IR_CALL || op >= IR_JUMP)) {
+            used[id] = 1;
+            worklist[count++] = id;
+        }
+    }
+    while (count > 0) {
+        int id = worklist[--count];
+        for (int i = 0; i < ir[id].arg_count; i++) {
+            int arg = resolve(ir[id].args[i]);
+            if (!used[arg]) {
+                used[arg] = 1;
+                worklist[count++] = arg;
+            }
+        }
+    }
+    for (int id = 0; id < ir_count; id++) {
+        if (ir[id].block >= 0 && !used[id]) {
+            deleteInstr(id);
+            changed = 1;
+        }
+    }
+
+    free(used);
+    free(worklist);
+    return changed;
+}
+
+void optimizeIR() {
+    for (int changed = 1; changed;) {
+        changed = propagateCopies();
+        changed |= foldConstants();
+        changed |= removeUnreachableBlocks();
+        changed |= eliminateCommonSubexpressions();
+    }
+    hoistLoopInvariants();
+    eliminateDeadStores();
+}
+
+// IR Dump
+//
+// A constant is printed where it is used, and lowering emits nothing for
+// it, so its own instruction is left out of the dump.
+void printValue(FILE *out, int value) {
+    value = resolve(value);
+    if (ir[value].op == IR_CONST) fprintf(out, "%d", ir[value].constant);
+    else fprintf(out, "v%d", value);
+}
+
+void dumpIR(FILE *out) {
+    static const char *names[] = {"const", "copy", "add", "sub", "param", "call", "phi", "out", "jump", "branch",
+                                  "halt", "ret"};
+
+    for (int l = 0; l < layout_count; l++) {
+        int block = layout[l];
+        IRBlock *b = &blocks[block];
+        if (b->removed) continue;
+
+        if (b->label) fprintf(out, "%s:\n", b->label);
+        fprintf(out, "bb%d:", block);
+        for (int p = 0; p < b->pred_count; p++) fprintf(out, "%s bb%d", p ? "," : " ; preds", b->preds[p]);
+        fprintf(out, "\n");
+
+        for (int i = 0; i < b->instr_count; i++) {
+            int id = b->instrs[i];
+            IRInstr *instr = &ir[id];
+            if (!isLive(id, block) || instr->op == IR_CONST) continue;
+
+            fprintf(out, "    ");
+            if (instr->op <= IR_PHI) fprintf(out, "v%d = ", id);
+            fprintf(out, "%s", names[instr->op]);
+
+            if (instr->op == IR_PARAM) {
+                fprintf(out, " %c", 'B' + instr->constant);
+            } else if (instr->op == IR_PHI) {
+                for (int a = 0; a < instr->arg_count; a++) {
+                    fprintf(out, "%s[", a ? ", " : " ");
+                    printValue(out, instr->args[a]);
+                    fprintf(out, ", bb%d]", b->preds[a]);
+                }
+            } else if (instr->op == IR_BRANCH) {
+                fprintf(out, " ");
+                printValue(out, instr->args[0]);
+                fprintf(out, " %s ", instr->compare);
+                printValue(out, instr->args[1]);
+                fprintf(out, ", bb%d, bb%d", instr->targets[0], instr->targets[1]);
+            } else if (instr->op == IR_JUMP) {
+                fprintf(out, " bb%d", instr->targets[0]);
+            } else {
+                if (instr->op == IR_CALL) fprintf(out, " %s", functions[instr->constant].node->value);
+                for (int a = 0; a < instr->arg_count; a++) {
+                    fprintf(out, "%s", a || instr->op == IR_CALL ? ", " : " ");
+                    printValue(out, instr->args[a]);
+                }
+            }
+
+            if (instr->variable >= 0) fprintf(out, "    ; %s", symbols[instr->variable]);
+            fprintf(out, "\n");
+        }
+    }
+}
+
+// Slot Coalescing
+//
+// A phi and its operands share one .data byte whenever their live ranges
+// do not overlap, so the copy on the edge disappears. Liveness is solved
+// backwards over the blocks; two values interfere when one is live where
+// the other is written.
+
+int set_bytes = 0;
+unsigned char *interference = NULL;   // ir_count rows of set_bytes
+int *slot_class = NULL;               // Union-find parent of each value
+int *class_next = NULL;               // Next member of the same class
+
+#define SET_TEST(set, i) ((set)[(i) >> 3] & (1 << ((i) & 7)))
+#define SET_ADD(set, i) ((set)[(i) >> 3] |= (1 << ((i) & 7)))
+#define SET_REMOVE(set, i) ((set)[(i) >> 3] &= ~(1 << ((i) & 7)))
+
+int slotClass(int value) {
+    while (slot_class[value] != value) value = slot_class[value] = slot_class[slot_class[value]];
+    return value;
+}
+
+int needsSlot(int value) {
+    return ir[value].op != IR_CONST;
+}
+
+int predIndex(int block, int pred) {
+    for (int p = 0; p < blocks[block].pred_count; p++) {
+        if (blocks[block].preds[p] == pred) return p;
+    }
+    return -1;
+}
+
+void addUse(unsigned char *live, int value) {
+    value = resolve(value);
+    if (needsSlot(value)) SET_ADD(live, value);
+}
+
+// Values live on leaving 'block': live into a successor, or read by one of
+// the successor's phis on this edge
+void computeLiveOut(int block, unsigned char **live_in, unsigned char *out) {
+    memset(out, 0, set_bytes);
+    if (terminator(block) < 0) return;
+    for (int s = 0; s < successorCount(block); s++) {
+        int target = successor(block, s);
+        IRBlock *t = &blocks[target];
+        int index = predIndex(target, block);
+        for (int i = 0; i < set_bytes; i++) out[i] |= live_in[target][i];
+        for (int i = 0; i < t->instr_count; i++) {
+            int id = t->instrs[i];
+            if (isLive(id, target) && ir[id].op == IR_PHI) addUse(out, ir[id].args[index]);
+        }
+    }
+}
+
+// Walk 'block' backwards from its live-out set. With 'interfere' set, each
+// definition is marked as interfering with everything live past it. The
+// block's phis are left in the set.
+void scanBlock(int block, unsigned char *live, int interfere) {
+    IRBlock *b = &blocks[block];
+    for (int i = b->instr_count - 1; i >= 0; i--) {
+        int id = b->instrs[i];
+        if (!isLive(id, block) || ir[id].op == IR_PHI) continue;
+        if (needsSlot(id) && ir[id].op < IR_PHI) {
+            SET_REMOVE(live, id);
+            if (interfere) {
+                for (int v = 0; v < ir_count; v++) {
+                    if (SET_TEST(live, v)) {
+                        SET_ADD(interference + (size_t)id * set_bytes, v);
+                        SET_ADD(interference + (size_t)v * set_bytes, id);
+                    }
+                }
+            }
+        }
+        for (int a = 0; a < ir[id].arg_count; a++) addUse(live, ir[id].args[a]);
+    }
+}
+
+void markInterference(int a, int b) {
+    SET_ADD(interference + (size_t)a * set_bytes, b);
+    SET_ADD(interference + (size_t)b * set_bytes, a);
+}
+
+int classesInterfere(int a, int b) {
+    for (int m = slotClass(b); m >= 0; m = class_next[m]) {
+        for (int n = slotClass(a); n >= 0; n = class_next[n]) {
+            if (SET_TEST(interference + (size_t)n * set_bytes, m)) return 1;
+        }
+    }
+    return 0;
+}
+
+void mergeClasses(int a, int b) {
+    a = slotClass(a);
+    b = slotClass(b);
+    int last = a;
+    while (class_next[last] >= 0) last = class_next[last];
+    class_next[last] = b;
+    slot_class[b] = a;
+}
+
+void coalesceSlots() {
+    set_bytes = (ir_count + 7) / 8;
+    unsigned char **live_in = calloc(block_count, sizeof(unsigned char *));
+    unsigned char **live_out = calloc(block_count, sizeof(unsigned char *));
+    unsigned char *live = malloc(set_bytes);
+
+    interference = calloc((size_t)ir_count * set_bytes, 1);
+    slot_class = malloc(ir_count * sizeof(int));
+    class_next = malloc(ir_count * sizeof(int));
+    for (int b = 0; b < block_count; b++) {
+        live_in[b] = calloc(set_bytes, 1);
+        live_out[b] = calloc(set_bytes, 1);
+    }
+    for (int v = 0; v < ir_count; v++) {
+        slot_class[v] = v;
+        class_next[v] = -1;
+    }
+
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (int l = layout_count - 1; l >= 0; l--) {
+            int block = layout[l];
+            if (blocks[block].removed) continue;
+            computeLiveOut(block, live_in, live_out[block]);
+            memcpy(live, live_out[block], set_bytes);
+            scanBlock(block, live, 0);
+            for (int i = 0; i < blocks[block].instr_count; i++) {
+                int id = blocks[block].instrs[i];
+                if (isLive(id, block) && ir[id].op == IR_PHI) SET_REMOVE(live, id);
+            }
+            if (memcmp(live, live_in[block], set_bytes) != 0) {
+                memcpy(live_in[block], live, set_bytes);
+                changed = 1;
+            }
+        }
+    }
+
+    for (int l = 0; l < layout_count; l++) {
+        int block = layout[l];
+        IRBlock *b = &blocks[block];
+        if (b->removed) continue;
+        memcpy(live, live_out[block], set_bytes);
+
+        // Copies into a successor's phis are made before a branch, while
+        // everything live out of the block and the compared values are live
+        int term = terminator(block);
+        if (term >= 0 && ir[term].op == IR_BRANCH) {
+            unsigned char *at_copy = malloc(set_bytes);
+            memcpy(at_copy, live, set_bytes);
+            for (int a = 0; a < 2; a++) addUse(at_copy, ir[term].args[a]);
+            for (int s = 0; s < 2; s++) {
+                IRBlock *t = &blocks[ir[term].targets[s]];
+                for (int i = 0; i < t->instr_count; i++) {
+                    int phi = t->instrs[i];
+                    if (!isLive(phi, ir[term].targets[s]) || ir[phi].op != IR_PHI) continue;
+                    for (int v = 0; v < ir_count; v++) {
+                        if (v != phi && SET_TEST(at_copy, v)) markInterference(phi, v);
+                    }
+                }
+            }
+            free(at_copy);
+        }
+        scanBlock(block, live, 1);
+
+        // Phis are written together on entry, alongside whatever is live in
+        for (int i = 0; i < b->instr_count; i++) {
+            int phi = b->instrs[i];
+            if (!isLive(phi, block) || ir[phi].op != IR_PHI) continue;
+            for (int v = 0; v < ir_count; v++) {
+                if (v != phi && SET_TEST(live, v)) markInterference(phi, v);
+            }
+            for (int j = 0; j < b->instr_count; j++) {
+                int other = b->instrs[j];
+                if (other != phi && isLive(other, block) && ir[other].op == IR_PHI) markInterference(phi, other);
+            }
+        }
+    }
+
+    for (int l = 0; l < layout_count; l++) {
+        int block = layout[l];
+        IRBlock *b = &blocks[block];
+        if (b->removed) continue;
+        for (int i = 0; i < b->instr_count; i++) {
+            int phi = b->instrs[i];
+            if (!isLive(phi, block) || ir[phi].op != IR_PHI) continue;
+            for (int p = 0; p < b->pred_count; p++) {
+                int arg = resolve(ir[phi].args[p]);
+                if (!needsSlot(arg) || slotClass(arg) == slotClass(phi)) continue;
+                if (!classesInterfere(phi, arg)) mergeClasses(phi, arg);
+            }
+        }
+    }
+
+    // The copies on an edge read every source before writing any phi, so a
+    // phi must not share a byte with another copy's source. Coalescing is
+    // done by now; this only matters to the memory layout.
+    for (int l = 0; l < layout_count; l++) {
+        int block = layout[l];
+        IRBlock *b = &blocks[block];
+        if (b->removed) continue;
+        for (int i = 0; i < b->instr_count; i++) {
+            int phi = b->instrs[i];
+            if (!isLive(phi, block) || ir[phi].op != IR_PHI) continue;
+            for (int j = 0; j < b->instr_count; j++) {
+                int other = b->instrs[j];
+                if (other == phi || !isLive(other, block) || ir[other].op != IR_PHI) continue;
+                for (int p = 0; p < ir[other].arg_count; p++) {
+                    int source = resolve(ir[other].args[p]);
+                    if (needsSlot(source)) markInterference(phi, source);
+                }
+            }
+        }
+    }
+
+    for (int b = 0; b < block_count; b++) {
+        free(live_in[b]);
+        free(live_out[b]);
+    }
+    free(live_in);
+    free(live_out);
+    free(live);
+}
+
+void freeSlots() {
+    free(interference);
+    free(slot_class);
+    free(class_next);
+}
+
+// Code Generator
+//
+// Every non-constant value lives in the .data cell of its slot class,
+// int_bytes bytes with the low one first. A value whose only use is the
+// next instruction, which wants it in A anyway, is never stored; a wide
+// one is kept in registers from C up instead, low byte in C.
+
+FILE *asm_output = NULL;
+int emitted_count = 0;
+int emitted_bytes = 0;
+char *is_read = NULL;   // Slot classes some instruction loads from
+char *is_written = NULL;   // Slot classes some instruction stores to
+long long *initial = NULL;   // Starting contents of each slot, -1 if not set
+int *use_count = NULL;
+int *slot_cell = NULL;   // Data cell of each slot class, -1 before planning
+int *cell_owner = NULL;   // First slot class given each cell, which names it
+int cell_count = 0;
+int *block_frame = NULL;   // 0 for the program's blocks, f + 1 for function f's
+int current_frame = 0;
+int frame_pushes[MAX_FUNCTIONS + 1];   // Most bytes pushed at once by a phi copy
+int a_holds = -1;      // Value currently in register A, -1 if unknown
+int a_slot = -1;       // Slot class whose byte A matches, -1 if none
+int regs_hold = -1;    // Wide value currently in C up, -1 if none
+int local_labels = 0;  // Labels made inside a wide operation so far
+
+// An instruction takes a byte, plus one for a number or %name operand
+int instructionBytes(const char *line) {
+    int bytes = 1;
+    for (const char *p = strchr(line, ' '); p; p = strchr(p + 1, ' ')) {
+        if (p[1] == '%' || isdigit((unsigned char)p[1])) bytes++;
+    }
+    return bytes;
+}
+
+void emit(const char *format, ...) {
+    char line[128];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    emitted_count++;
+    emitted_bytes += instructionBytes(line);
+    if (asm_output) fprintf(asm_output, "    %s\n", line);
+}
+
+char *has_label = NULL;
+
+void emitLabel(int block) {
+    if (asm_output && blocks[block].label) fprintf(asm_output, "%s:\n", blocks[block].label);
+    else if (asm_output && has_label[block]) fprintf(asm_output, "_bb%d:\n", block);
+}
+
+const char *className(int value) {
+    static char name[2][128];
+    static int turn = 0;
+    turn = 1 - turn;
+    value = slotClass(value);
+    if (ir[value].variable >= 0) sprintf(name[turn], "%s_%d", symbols[ir[value].variable], value);
+    else sprintf(name[turn], "_t%d", value);
+    return name[turn];
+}
+
+// A cell shared by several slot classes is named after the first of them
+const char *slotName(int value) {
+    value = slotClass(value);
+    if (slot_cell[value] < 0) return className(value);
+    return className(cell_owner[slot_cell[value]]);
+}
+
+// Byte i of a cell is called name.i, except the first
+const char *byteName(const char *name, int i) {
+    static char bytes[2][132];
+    static int turn = 0;
+    turn = 1 - turn;
+    if (i == 0) snprintf(bytes[turn], sizeof(bytes[turn]), "%s", name);
+    else snprintf(bytes[turn], sizeof(bytes[turn]), "%s.%d", name, i);
+    return bytes[turn];
+}
+
+// Whether A already has 'value', either computed there or equal to its slot
+int holdsA(int value) {
+    return a_holds == value || (needsSlot(value) && a_slot == slotClass(value));
+}
+
+// A is about to be overwritten with 'value', which is in no slot yet
+void setA(int value) {
+    a_holds = value;
+    a_slot = -1;
+}
+
+void loadA(int value) {
+    value = resolve(value);
+    if (holdsA(value)) {
+        a_holds = value;
+        return;
+    }
+    if (isConstant(value)) {
+        emit("ldi A %d", ir[value].constant);
+        setA(value);
+    } else {
+        is_read[slotClass(value)] = 1;
+        emit("lda %%%s", slotName(value));
+        a_holds = value;
+        a_slot = slotClass(value);
+    }
+}
+
+// Put 'value' in a register other than A
+void loadRegister(char reg, int value) {
+    value = resolve(value);
+    if (isConstant(value)) {
+        emit("ldi %c %d", reg, ir[value].constant);
+    } else if (holdsA(value)) {
+        emit("mov %c A", reg);
+    } else {
+        is_read[slotClass(value)] = 1;
+        emit("mov %c M %%%s", reg, slotName(value));
+    }
+}
+
+// Put 'a' in A and 'b' in B
+void loadOperands(int a, int b) {
+    a = resolve(a);
+    b = resolve(b);
+    if (holdsA(b) && !holdsA(a)) {
+        loadRegister('B', b);
+        loadA(a);
+    } else {
+        loadA(a);
+        loadRegister('B', b);
+    }
+}
+
+// A store to a slot that is never loaded from is left out, but A is still
+// taken to match it so that every pass makes the same choices
+void storeA(int value, int forwarded) {
+    if (forwarded) return;
+    if (is_read[slotClass(value)]) {
+        emit("sta %%%s", slotName(value));
+        is_written[slotClass(value)] = 1;
+    }
+    a_slot = slotClass(value);
+}
+
+// A phi copy that has work to do: its operand is in another slot
+int needsCopy(int phi, int index) {
+    return slotClass(resolve(ir[phi].args[index])) != slotClass(phi);
+}
+
+// A constant copied into a slot by the entry block, before anything else
+// writes it, can be the slot's starting contents instead
+int isInitialValue(int phi, int source, int block) {
+    IRBlock *b = &blocks[block];
+    int term = terminator(block), value;
+    if (block != layout[0] || ir[term].op != IR_JUMP || !constantValue(source, &value)) return 0;
+    for (int i = 0; i < b->instr_count; i++) {
+        int id = b->instrs[i];
+        if (isLive(id, block) && needsSlot(id) && slotClass(id) == slotClass(phi)) return 0;
+    }
+    initial[slotClass(phi)] = (unsigned)value;
+    return 1;
+}
+
+// Wide ints
+//
+// Without A to track, every byte is loaded where the instruction wants it
+// and stored as soon as it is made. A forwarded value stays in registers C
+// up, C and D for a 16-bit int, so its consumer takes it from there.
+
+int constantByte(int value, int i) {
+    return ((unsigned)ir[resolve(value)].constant >> (8 * i)) & 0xFF;
+}
+
+// Put byte i of 'value' in 'reg'
+void loadByte(char reg, int value, int i) {
+    value = resolve(value);
+    if (isConstant(value)) {
+        emit("ldi %c %d", reg, constantByte(value, i));
+    } else if (regs_hold == value) {
+        if (reg != 'C' + i) emit("mov %c %c", reg, 'C' + i);
+    } else {
+        is_read[slotClass(value)] = 1;
+        if (reg == 'A') emit("lda %%%s", byteName(slotName(value), i));
+        else emit("mov %c M %%%s", reg, byteName(slotName(value), i));
+    }
+}
+
+// Byte i of 'value' is in 'reg': keep it in C up or store it
+void storeByte(char reg, int value, int i, int forwarded) {
+    if (forwarded) {
+        if (reg != 'C' + i) emit("mov %c %c", 'C' + i, reg);
+    } else if (is_read[slotClass(value)]) {
+        if (reg == 'A') emit("sta %%%s", byteName(slotName(value), i));
+        else emit("mov M %c %%%s", reg, byteName(slotName(value), i));
+        is_written[slotClass(value)] = 1;
+    }
+}
+
+int newLocalLabel() {
+    return local_labels++;
+}
+
+void emitLocalLabel(int label) {
+    if (asm_output) fprintf(asm_output, "_w%d:\n", label);
+}
+
+// add, then adc for every byte above the first, which takes the carry
+void lowerWideAdd(int id, int forwarded) {
+    int a = ir[id].args[0], b = ir[id].args[1];
+    for (int i = 0; i < int_bytes; i++) {
+        loadByte('A', a, i);
+        if (i == 0 && isConstant(b) && constantByte(b, 0) == 1) {
+            emit("inc");
+        } else {
+            loadByte('B', b, i);
+            emit(i == 0 ? "add" : "adc");
+        }
+        storeByte('A', id, i, forwarded);
+    }
+}
+
+// There is no subtract with borrow. sub leaves the borrow in carry, so a
+// byte above the first takes one more off: with dec on the top byte, or by
+// subtracting k + 1 instead of a constant k. Otherwise the borrow goes into
+// the subtrahend with adc, where it may overflow: then a.i - 256 is a.i and
+// the borrow is out again.
+void lowerWideSub(int id, int forwarded) {
+    int a = ir[id].args[0], b = ir[id].args[1];
+    for (int i = 0; i < int_bytes; i++) {
+        if (i == 0) {
+            loadByte('A', a, 0);
+            if (isConstant(b) && constantByte(b, 0) == 1) {
+                emit("dec");
+            } else {
+                loadByte('B', b, 0);
+                emit("sub");
+            }
+        } else if (isConstant(b)) {
+            int k = constantByte(b, i), skip = newLocalLabel();
+            loadByte('A', a, i);
+            if (k == 0) {
+                emit("jnc %%_w%d", skip);
+                emit("dec");
+                emitLocalLabel(skip);
+            } else if (k == 255) {
+                emit("jc %%_w%d", skip);
+                emit("ldi B 255");
+                emit("sub");
+                emitLocalLabel(skip);
+            } else {
+                emit("ldi B %d", k);
+                emit("jnc %%_w%d", skip);
+                emit("ldi B %d", k + 1);
+                emitLocalLabel(skip);
+                emit("sub");
+            }
+        } else if (i == int_bytes - 1) {
+            int no_borrow = newLocalLabel();
+            loadByte('A', a, i);
+            loadByte('B', b, i);
+            emit("jnc %%_w%d", no_borrow);
+            emit("dec");
+            emitLocalLabel(no_borrow);
+            emit("sub");
+        } else {
+            int overflow = newLocalLabel(), done = newLocalLabel();
+            loadByte('A', b, i);
+            emit("ldi B 0");
+            emit("adc");
+            emit("jc %%_w%d", overflow);
+            emit("mov B A");
+            loadByte('A', a, i);
+            emit("sub");
+            emit("jmp %%_w%d", done);
+            emitLocalLabel(overflow);
+            loadByte('A', a, i);
+            emitLocalLabel(done);
+        }
+        storeByte('A', id, i, forwarded);
+    }
+}
+
+// Compare from the top byte down, leaving as soon as a byte decides
+void lowerWideCompare(const char *op, int a, int b, int target, int other) {
+    for (int i = int_bytes - 1; i >= 0; i--) {
+        loadByte('A', a, i);
+        loadByte('B', b, i);
+        emit("cmp");
+        if (i == 0) break;
+        if (strcmp(op, "==") == 0) {
+            emit("jne %%_bb%d", other);
+        } else if (strcmp(op, "!=") == 0) {
+            emit("jne %%_bb%d", target);
+        } else if (strcmp(op, "<") == 0) {
+            emit("jc %%_bb%d", target);
+            emit("jne %%_bb%d", other);
+        } else {
+            emit("jc %%_bb%d", other);
+            emit("jne %%_bb%d", target);
+        }
+        has_label[target] = 1;
+        if (strcmp(op, "!=") != 0) has_label[other] = 1;
+    }
+}
+
+// Returns 0 for an instruction lowered the same way at every width
+int lowerWide(int id, int forwarded) {
+    IRInstr *instr = &ir[id];
+    switch (instr->op) {
+        case IR_COPY:
+            if (!forwarded && !is_read[slotClass(id)]) break;
+            for (int i = 0; i < int_bytes; i++) {
+                loadByte(forwarded ? 'C' + i : 'A', instr->args[0], i);
+                if (!forwarded) storeByte('A', id, i, 0);
+            }
+            break;
+        case IR_ADD:
+            lowerWideAdd(id, forwarded);
+            break;
+        case IR_SUB:
+            lowerWideSub(id, forwarded);
+            break;
+        case IR_PARAM:
+            // Argument registers are all taken, so every argument is stored
+            forwarded = 0;
+            for (int i = 0; i < int_bytes; i++) storeByte('B' + instr->constant * int_bytes + i, id, i, 0);
+            break;
+        case IR_CALL:
+            for (int a = 0; a < instr->arg_count; a++) {
+                for (int i = 0; i < int_bytes; i++) loadByte('B' + a * int_bytes + i, instr->args[a], i);
+            }
+            emit("call %%%s", functions[instr->constant].node->value);
+            for (int i = 0; i < int_bytes && !forwarded; i++) storeByte('C' + i, id, i, 0);
+            break;
+        case IR_OUT:
+            for (int i = int_bytes - 1; i >= 0; i--) {
+                loadByte('A', instr->args[0], i);
+                emit("out 0");
+            }
+            break;
+        case IR_RET:
+            for (int i = 0; i < instr->arg_count * int_bytes; i++) loadByte('C' + i, instr->args[0], i);
+            emit("ret");
+            break;
+        default:
+            return 0;
+    }
+    regs_hold = forwarded ? id : -1;
+    return 1;
+}
+
+// Phi copies of wide ints, a byte at a time. With a conflict, all the bytes
+// are pushed before any is popped.
+void emitWidePhiCopies(int *phis, int count, int index, int block, int conflict) {
+    if (!conflict) {
+        for (int i = 0; i < count; i++) {
+            if (isInitialValue(phis[i], ir[phis[i]].args[index], block)) continue;
+            for (int k = 0; k < int_bytes; k++) {
+                loadByte('A', ir[phis[i]].args[index], k);
+                storeByte('A', phis[i], k, 0);
+            }
+        }
+        return;
+    }
+
+    if (count * int_bytes > frame_pushes[current_frame]) frame_pushes[current_frame] = count * int_bytes;
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < int_bytes; k++) {
+            loadByte('A', ir[phis[i]].args[index], k);
+            emit("push A");
+        }
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        for (int k = int_bytes - 1; k >= 0; k--) {
+            emit("pop A");
+            storeByte('A', phis[i], k, 0);
+        }
+    }
+}
+
+// Phi copies on the edge block -> target, as a parallel copy. When a copy
+// reads a slot that another copy of the same edge writes, every source is
+// pushed first and then popped into place.
+void emitPhiCopies(int block, int target) {
+    IRBlock *t = &blocks[target];
+    int index = -1, phis[MAX_SYMBOLS * 4], count = 0, conflict = 0;
+
+    for (int p = 0; p < t->pred_count; p++) {
+        if (t->preds[p] == block) index = p;
+    }
+    for (int i = 0; i < t->instr_count && count < MAX_SYMBOLS * 4; i++) {
+        int id = t->instrs[i];
+        if (isLive(id, target) && ir[id].op == IR_PHI && needsCopy(id, index)) phis[count++] = id;
+    }
+    for (int i = 0; i < count; i++) {
+        int source = resolve(ir[phis[i]].args[index]);
+        for (int j = 0; j < count; j++) {
+            if (i != j && needsSlot(source) && slotClass(source) == slotClass(phis[j])) conflict = 1;
+        }
+    }
+
+    if (int_bytes > 1) {
+        emitWidePhiCopies(phis, count, index, block, conflict);
+        return;
+    }
+
+    if (!conflict) {
+        for (int i = 0; i < count; i++) {
+            if (isInitialValue(phis[i], ir[phis[i]].args[index], block)) continue;
+            loadA(ir[phis[i]].args[index]);
+            storeA(phis[i], 0);
+        }
+        return;
+    }
+
+    if (count > frame_pushes[current_frame]) frame_pushes[current_frame] = count;
+    for (int i = 0; i < count; i++) {
+        loadA(ir[phis[i]].args[index]);
+        emit("push A");
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        emit("pop A");
+        setA(phis[i]);
+        storeA(phis[i], 0);
+    }
+}
+
+// Value 'value' takes on the edge block -> target, where it may be one of
+// target's phis. Returns 0 when it is not a known constant.
+int edgeConstant(int value, int block, int target, int *result) {
+    value = resolve(value);
+    if (ir[value].op == IR_PHI && ir[value].block == target) {
+        value = resolve(ir[value].args[predIndex(target, block)]);
+    }
+    return constantValue(value, result);
+}
+
+// A jump into a block that only tests its phis can go straight to the
+// side the test takes on that edge, as a rotated loop does on entry.
+// Returns that side, or -1.
+int threadedTarget(int block, int target) {
+    IRBlock *t = &blocks[target];
+    int branch = terminator(target), a, b;
+    if (branch < 0 || ir[branch].op != IR_BRANCH) return -1;
+    for (int i = 0; i < t->instr_count; i++) {
+        int id = t->instrs[i];
+        if (isLive(id, target) && id != branch && ir[id].op != IR_PHI && ir[id].op != IR_CONST) return -1;
+    }
+    if (!edgeConstant(ir[branch].args[0], block, target, &a)) return -1;
+    if (!edgeConstant(ir[branch].args[1], block, target, &b)) return -1;
+    return ir[branch].targets[compareValues(ir[branch].compare, a, b) ? 0 : 1];
+}
+
+int hasPhis(int block) {
+    IRBlock *b = &blocks[block];
+    for (int i = 0; i < b->instr_count; i++) {
+        if (isLive(b->instrs[i], block) && ir[b->instrs[i]].op == IR_PHI) return 1;
+    }
+    return 0;
+}
+
+// Source of the first phi copy on the edge block -> target
+int firstPhiCopySource(int block, int target) {
+    IRBlock *t = &blocks[target];
+    int index = -1;
+    for (int p = 0; p < t->pred_count; p++) {
+        if (t->preds[p] == block) index = p;
+    }
+    for (int i = 0; i < t->instr_count; i++) {
+        int id = t->instrs[i];
+        if (isLive(id, target) && ir[id].op == IR_PHI && needsCopy(id, index)) {
+            return resolve(ir[id].args[index]);
+        }
+    }
+    return -1;
+}
+
+// Value that the instruction loads into A first, -1 if none
+int firstOperand(int id) {
+    int block = ir[id].block;
+    switch (ir[id].op) {
+        case IR_JUMP:
+            return firstPhiCopySource(block, ir[id].targets[0]);
+        case IR_COPY:
+        case IR_OUT:
+            return resolve(ir[id].args[0]);
+        case IR_RET:
+            return ir[id].arg_count ? resolve(ir[id].args[0]) : -1;
+        case IR_ADD:
+        case IR_SUB:
+            return resolve(ir[id].args[0]) == resolve(ir[id].args[1]) ? -1 : resolve(ir[id].args[0]);
+        case IR_BRANCH: {
+            const char *op = ir[id].compare;
+            for (int s = 0; s < 2; s++) {
+                if (hasPhis(ir[id].targets[s])) return firstPhiCopySource(block, ir[id].targets[s]);
+            }
+            int swap = strcmp(op, ">") == 0 || strcmp(op, "<=") == 0;
+            int a = resolve(ir[id].args[swap]), b = resolve(ir[id].args[1 - swap]);
+            return a == b ? -1 : a;
+        }
+        default:
+            return -1;
+    }
+}
+
+// The instruction following position in the block that emits code, -1 if
+// none. Constants and phis emit nothing.
+int nextInstr(int block, int position) {
+    IRBlock *b = &blocks[block];
+    for (int i = position + 1; i < b->instr_count; i++) {
+        int id = b->instrs[i];
+        if (isLive(id, block) && ir[id].op != IR_CONST && ir[id].op != IR_PHI) return id;
+    }
+    return -1;
+}
+
+// Branch to if_true when 'a compare b', falling through to 'next' when
+// possible. cmp sets zero when A == B and carry when A < B (unsigned).
+void lowerBranch(int id, int next) {
+    IRInstr *instr = &ir[id];
+    const char *op = instr->compare;
+    int target = instr->targets[0], other = instr->targets[1];
+    int a = instr->args[0], b = instr->args[1];
+    const char *jump;
+
+    if (target == next) {
+        target = instr->targets[1];
+        other = instr->targets[0];
+        op = strcmp(op, "==") == 0 ? "!=" : strcmp(op, "!=") == 0 ? "==" :
+             strcmp(op, "<") == 0 ? ">=" : strcmp(op, ">=") == 0 ? "<" :
+             strcmp(op, ">") == 0 ? "<=" : ">";
+    }
+
+    // a > b and a <= b are b < a and b >= a with the operands swapped
+    if (strcmp(op, ">") == 0 || strcmp(op, "<=") == 0) {
+        int swap = a;
+        a = b;
+        b = swap;
+        op = strcmp(op, ">") == 0 ? "<" : ">=";
+    }
+
+    if (strcmp(op, "==") == 0) jump = "je";
+    else if (strcmp(op, "!=") == 0) jump = "jne";
+    else if (strcmp(op, "<") == 0) jump = "jc";
+    else jump = "jnc";
+
+    if (int_bytes > 1) {
+        lowerWideCompare(op, a, b, target, other);
+    } else {
+        loadOperands(a, b);
+        emit("cmp");
+    }
+    emit("%s %%_bb%d", jump, target);
+    has_label[target] = 1;
+    if (other != next) {
+        emit("jmp %%_bb%d", other);
+        has_label[other] = 1;
+    }
+}
+
+void lowerBlock(int block, int next) {
+    IRBlock *b = &blocks[block];
+
+    for (int i = 0; i < b->instr_count; i++) {
+        int id = b->instrs[i];
+        IRInstr *instr = &ir[id];
+        if (!isLive(id, block)) continue;
+
+        int following = nextInstr(block, i);
+        int forwarded = use_count[id] == 1 && following >= 0 && firstOperand(following) == id;
+        if (int_bytes > 1 && lowerWide(id, forwarded)) continue;
+
+        switch (instr->op) {
+            case IR_CONST:
+            case IR_PHI:
+                break;
+            case IR_COPY:
+                loadA(instr->args[0]);
+                storeA(id, forwarded);
+                a_holds = id;
+                break;
+            case IR_ADD:
+            case IR_SUB: {
+                const Replacement *r = NULL;
+                int c;
+                if (constantValue(instr->args[1], &c)) r = &add_constant[(instr->op == IR_ADD ? c : -c) & 0xFF];
+                if (r && (r->cycles < CONSTANT_OPERAND_CYCLES || r->bytes < CONSTANT_OPERAND_BYTES)) {
+                    loadA(instr->args[0]);
+                    for (int k = 0; r->code[k]; k++) emit("%s", r->code[k]);
+                } else {
+                    loadOperands(instr->args[0], instr->args[1]);
+                    emit(instr->op == IR_ADD ? "add" : "sub");
+                }
+                setA(id);
+                storeA(id, forwarded);
+                break;
+            }
+            case IR_PARAM:
+                // Arguments arrive in B to G, before anything else uses them
+                if (forwarded) {
+                    emit("mov A %c", 'B' + instr->constant);
+                    setA(id);
+                } else if (is_read[slotClass(id)]) {
+                    emit("mov M %c %%%s", 'B' + instr->constant, slotName(id));
+                    is_written[slotClass(id)] = 1;
+                }
+                break;
+            case IR_CALL:
+                for (int a = 0; a < instr->arg_count; a++) loadRegister('B' + a, instr->args[a]);
+                emit("call %%%s", functions[instr->constant].node->value);
+                setA(id);
+                storeA(id, forwarded);
+                break;
+            case IR_OUT:
+                loadA(instr->args[0]);
+                emit("out 0");
+                break;
+            case IR_JUMP: {
+                int target = instr->targets[0];
+                int threaded = threadedTarget(block, target);
+                emitPhiCopies(block, target);
+                if (threaded >= 0) {
+                    emitPhiCopies(target, threaded);
+                    target = threaded;
+                }
+                if (target != next) {
+                    emit("jmp %%_bb%d", target);
+                    has_label[target] = 1;
+                }
+                break;
+            }
+            case IR_BRANCH:
+                // Copies for a successor with several predecessors are made
+                // before the branch: the other successor never reads them
+                for (int s = 0; s < 2; s++) {
+                    if (hasPhis(instr->targets[s])) emitPhiCopies(block, instr->targets[s]);
+                }
+                lowerBranch(id, next);
+                break;
+            case IR_HALT:
+                emit("hlt");
+                break;
+            case IR_RET:
+                if (instr->arg_count) loadA(instr->args[0]);
+                emit("ret");
+                break;
+        }
+    }
+}
+
+void lowerBlocks() {
+    emitted_count = 0;
+    emitted_bytes = 0;
+    local_labels = 0;
+    setA(-1);
+    for (int l = 0; l < layout_count; l++) {
+        int block = layout[l];
+        if (blocks[block].removed) continue;
+        current_frame = block_frame[block];
+
+        int next = -1;
+        for (int n = l + 1; n < layout_count && next < 0; n++) {
+            if (!blocks[layout[n]].removed) next = layout[n];
+        }
+        // Without a label the block is only entered by falling into it
+        if (has_label[block] || blocks[block].label) setA(-1);
+        regs_hold = -1;
+        emitLabel(block);
+        lowerBlock(block, next);
+    }
+}
+
+// Memory Layout
+//
+// asm.py places .data right after the code, one byte per entry in the order
+// they are listed, and the stack grows down from 0xff into the same 256
+// bytes. A slot takes a cell of int_bytes bytes, and slot classes that are
+// never live at the same time share a cell. Every function has a frame of
+// such cells starting past the frames of all its callers, so frames of
+// functions that are never active together overlap. A slot with a starting
+// value keeps its cell to itself, except that slots that are never written
+// and start with the same value are constants and share one.
+
+int isConstantSlot(int c) {
+    return initial[c] >= 0 && !is_written[c];
+}
+
+int canShareCell(int c, int d) {
+    if (isConstantSlot(c) && isConstantSlot(d)) return initial[c] == initial[d];
+    return initial[c] < 0 && initial[d] < 0 && !classesInterfere(c, d);
+}
+
+// Place every slot class that is loaded from. Returns the most bytes the
+// program can have on the stack.
+int planMemory() {
+    int frames = function_count + 1;
+    int size[MAX_FUNCTIONS + 1] = {0}, offset[MAX_FUNCTIONS + 1] = {0}, stack[MAX_FUNCTIONS + 1];
+    int *color = malloc(ir_count * sizeof(int));
+
+    for (int frame = 0; frame < frames; frame++) {
+        for (int c = 0; c < ir_count; c++) {
+            if (!is_read[c] || block_frame[ir[c].block] != frame) continue;
+            for (color[c] = optimize ? 0 : size[frame]; color[c] < size[frame]; color[c]++) {
+                int shared = 1;
+                for (int d = 0; d < c && shared; d++) {
+                    if (is_read[d] && block_frame[ir[d].block] == frame && color[d] == color[c]) shared = canShareCell(c, d);
+                }
+                if (shared) break;
+            }
+            if (color[c] == size[frame]) size[frame]++;
+        }
+    }
+
+    // Push callees past their callers, and callers' stack below their callees'
+    for (int frame = 0; frame < frames; frame++) stack[frame] = frame_pushes[frame];
+    for (int round = 0; round < frames; round++) {
+        for (int id = 0; id < ir_count; id++) {
+            if (ir[id].block < 0 || ir[id].op != IR_CALL) continue;
+            int caller = block_frame[ir[id].block], callee = ir[id].constant + 1;
+            if (offset[callee] < offset[caller] + size[caller]) offset[callee] = offset[caller] + size[caller];
+            if (stack[caller] < stack[callee] + 1) stack[caller] = stack[callee] + 1;
+        }
+    }
+
+    cell_count = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        if (offset[frame] + size[frame] > cell_count) cell_count = offset[frame] + size[frame];
+    }
+    cell_owner = malloc((cell_count + 1) * sizeof(int));
+    memset(cell_owner, -1, (cell_count + 1) * sizeof(int));
+    for (int frame = 0; frame < frames; frame++) {
+        for (int c = 0; c < ir_count; c++) {
+            if (!is_read[c] || block_frame[ir[c].block] != frame) continue;
+            slot_cell[c] = offset[frame] + color[c];
+            if (cell_owner[slot_cell[c]] < 0) cell_owner[slot_cell[c]] = c;
+        }
+    }
+
+    free(color);
+    return stack[0];
+}
+
+// Starting contents of a data cell
+long long cellValue(int cell) {
+    for (int c = 0; c < ir_count; c++) {
+        if (is_read[c] && slot_cell[c] == cell && initial[c] >= 0) return initial[c];
+    }
+    return 0;
+}
+
+void printMemoryMap(FILE *out, int stack) {
+    const char *frame_names[MAX_FUNCTIONS + 1] = {"program"};
+    for (int f = 0; f < function_count; f++) frame_names[f + 1] = functions[f].node->value;
+
+    int data = cell_count * int_bytes;
+    fprintf(out, "0x00  %-14s %d bytes\n", "code", emitted_bytes);
+    for (int cell = 0; cell < cell_count; cell++) {
+        fprintf(out, "0x%02x  %-14s", emitted_bytes + cell * int_bytes, className(cell_owner[cell]));
+        const char *separator = " ";
+        for (int c = 0; c < ir_count; c++) {
+            if (!is_read[c] || slot_cell[c] != cell) continue;
+            fprintf(out, "%s%s", separator, className(c));
+            if (block_frame[ir[c].block] > 0) fprintf(out, " (%s)", frame_names[block_frame[ir[c].block]]);
+            if (isConstantSlot(c)) fprintf(out, " = %lld", initial[c]);
+            separator = ", ";
+        }
+        fprintf(out, "\n");
+    }
+    fprintf(out, "0x%02x  %-14s %d bytes\n", emitted_bytes + data, "free", 256 - emitted_bytes - data - stack);
+    if (stack) fprintf(out, "0x%02x  %-14s %d bytes\n", 256 - stack, "stack", stack);
+}
+
+// Lower the IR to assembly, returning the number of instructions emitted.
+// A silent first pass finds which blocks are jumped to and need a label,
+// a second one which slots are ever loaded from. The data layout is planned
+// next, and a third silent pass measures the code before it is written out.
+int lowerIR(FILE *out, FILE *memory_map) {
+    is_read = calloc(ir_count, 1);
+    is_written = calloc(ir_count, 1);
+    initial = malloc(ir_count * sizeof(long long));
+    slot_cell = malloc(ir_count * sizeof(int));
+    has_label = calloc(block_count, 1);
+    use_count = calloc(ir_count, sizeof(int));
+    block_frame = calloc(block_count, sizeof(int));
+    memset(initial, -1, ir_count * sizeof(long long));
+    memset(slot_cell, -1, ir_count * sizeof(int));
+    memset(frame_pushes, 0, sizeof(frame_pushes));
+
+    for (int id = 0; id < ir_count; id++) {
+        if (ir[id].block < 0) continue;
+        for (int i = 0; i < ir[id].arg_count; i++) use_count[resolve(ir[id].args[i])]++;
+    }
+    for (int l = 0, frame = 0; l < layout_count; l++) {
+        for (int f = 0; f < function_count; f++) {
+            if (functions[f].entry == layout[l]) frame = f + 1;
+        }
+        block_frame[layout[l]] = frame;
+    }
+    coalesceSlots();
+
+    asm_output = NULL;
+    lowerBlocks();
+    lowerBlocks();
+    int stack = planMemory();
+    lowerBlocks();
+    if (out && emitted_bytes + cell_count * int_bytes + stack > 256) {
+        printf("Memory error: %d bytes of code, %d of data and %d of stack do not fit in 256\n",
+               emitted_bytes, cell_count * int_bytes, stack);
+        fail();
+    }
+    if (memory_map) printMemoryMap(memory_map, stack);
+
+    asm_output = out;
+    if (out) fprintf(out, ".text\n");
+    lowerBlocks();
+    if (out) {
+        fprintf(out, "\n.data\n");
+        for (int cell = 0; cell < cell_count; cell++) {
+            for (int i = 0; i < int_bytes; i++) {
+                fprintf(out, "%s = %lld\n", byteName(className(cell_owner[cell]), i), cellValue(cell) >> (8 * i) & 0xFF);
+            }
+        }
+    }
+
+    freeSlots();
+    free(is_read);
+    free(is_written);
+    free(initial);
+    free(slot_cell);
+    free(cell_owner);
+    free(has_label);
+    free(use_count);
+    free(block_frame);
+    slot_cell = cell_owner = NULL;
+    return emitted_count;
+}
+
+// Bytecode VM
+//
+// -run executes programs without the assembler or the CPU. The AST is
+// compiled to bytecode for a stack machine whose values are ints as wide as
+// -int makes them, so + and - wrap around and comparisons are unsigned, as
+// with add, sub and cmp in alu.v. The VM prints what the CPU would: the
+// bytes of each out(), high first, when it happens, then
+// every variable of the program. As in .data, each variable has one place,
+// and a call sets its function's variables to 0 before taking the arguments.
+
+#define VM_STACK 256
+
+typedef enum {
+    BC_CONST,    // k: push k
+    BC_LOAD,     // v: push variable v
+    BC_STORE,    // v: pop into variable v
+    BC_ADD,
+    BC_SUB,
+    BC_POP,
+    BC_OUT,      // Pop and print
+    BC_JUMP,     // t: continue at t
+    BC_JZ,       // t: pop a, jump if a == 0
+    BC_JNZ,
+    BC_JE,       // t: pop b and a, jump if a == b
+    BC_JNE,
+    BC_JLT,
+    BC_JGE,
+    BC_JGT,
+    BC_JLE,
+    BC_CALL,     // f: pop the arguments and call function f
+    BC_RET,      // A result stays on the stack
+    BC_HALT
+} BytecodeOp;
+
+int *bytecode = NULL;
+int bytecode_count = 0, bytecode_capacity = 0;
+int function_entry[MAX_FUNCTIONS];
+long vm_max_steps = 100000000;
+
+int emitBytecode(int word) {
+    bytecode = growArray(bytecode, &bytecode_capacity, bytecode_count, sizeof(int));
+    bytecode[bytecode_count] = word;
+    return bytecode_count++;
+}
+
+// Emit a jump and return the index of its target, to be patched
+int emitJumpBytecode(BytecodeOp op, int target) {
+    emitBytecode(op);
+    return emitBytecode(target);
+}
+
+// Jump taken when 'compare' holds, or with 'negate' when it does not
+BytecodeOp jumpFor(const char *compare, int negate) {
+    static const char *compares[] = {"==", "!=", "<", ">=", ">", "<="};
+    for (int i = 0; i < 6; i++) {
+        if (strcmp(compare, compares[i]) == 0) return BC_JE + (i ^ negate);
+    }
+    return negate ? BC_JZ : BC_JNZ;
+}
+
+void compileExpression(ASTNode *node);
+
+int compileCall(ASTNode *node) {
+    int count = 0;
+    for (ASTNode *arg = node->left; arg; arg = arg->next) {
+        compileExpression(arg);
+        count++;
+    }
+
+    if (strcmp(node->value, "out") == 0) {
+        if (count != 1) {
+            printf("Semantic error: 'out' takes 1 argument\n");
+            fail();
+        }
+        emitBytecode(BC_OUT);
+        return 0;
+    }
+
+    int f = findFunction(node->value);
+    Function *fn = &functions[f];
+    if (count != fn->params) {
+        printf("Semantic error: '%s' takes %d argument%s\n", node->value, fn->params, fn->params == 1 ? "" : "s");
+        fail();
+    }
+    emitBytecode(BC_CALL);
+    emitBytecode(f);
+    return fn->node->returns;
+}
+
+void compileExpression(ASTNode *node) {
+    switch (node->type) {
+        case AST_LITERAL:
+            emitBytecode(BC_CONST);
+            emitBytecode(literal(node->value));
+            break;
+        case AST_IDENTIFIER:
+            emitBytecode(BC_LOAD);
+            emitBytecode(findSymbol(node->value));
+            break;
+        case AST_BINARY_OP:
+            compileExpression(node->left);
+            compileExpression(node->right);
+            emitBytecode(strcmp(node->value, "+") == 0 ? BC_ADD : BC_SUB);
+            break;
+        case AST_CALL:
+            if (!compileCall(node)) {
+                printf("Semantic error: '%s' does not return a value\n", node->value);
+                fail();
+            }
+            break;
+        default:
+            printf("Unknown expression node type\n");
+            fail();
+    }
+}
+
+// Jump to 'target' when the condition is true, or false with 'negate'.
+// Returns the index of the target, to be patched.
+int compileCondition(ASTNode *condition, int negate, int target) {
+    if (condition->type == AST_BINARY_OP && !isArithmetic(condition)) {
+        compileExpression(condition->left);
+        compileExpression(condition->right);
+        return emitJumpBytecode(jumpFor(condition->value, negate), target);
+    }
+    compileExpression(condition);
+    return emitJumpBytecode(jumpFor("", negate), target);
+}
+
+void compileStatements(ASTNode *stmt) {
+    for (; stmt; stmt = stmt->next) {
+        switch (stmt->type) {
+            case AST_VAR_DECL:
+                if (current_scope < 0) declareSymbol(stmt->value);
+                break;
+            case AST_ASSIGN:
+                compileExpression(stmt->left);
+                emitBytecode(BC_STORE);
+                emitBytecode(findSymbol(stmt->value));
+                break;
+            case AST_IF: {
+                int skip = compileCondition(stmt->condition, 1, -1);
+                compileStatements(stmt->body);
+                if (stmt->right) {
+                    int end = emitJumpBytecode(BC_JUMP, -1);
+                    bytecode[skip] = bytecode_count;
+                    compileStatements(stmt->right);
+                    bytecode[end] = bytecode_count;
+                } else {
+                    bytecode[skip] = bytecode_count;
+                }
+                break;
+            }
+            case AST_WHILE: {
+                // The test is at the bottom, as in the generated code
+                int test = emitJumpBytecode(BC_JUMP, -1);
+                int top = bytecode_count;
+                compileStatements(stmt->body);
+                bytecode[test] = bytecode_count;
+                compileCondition(stmt->condition, 0, top);
+                break;
+            }
+            case AST_CALL:
+                if (compileCall(stmt)) emitBytecode(BC_POP);
+                break;
+            case AST_RETURN: {
+                if (current_scope < 0) {
+                    printf("Semantic error: return outside a function\n");
+                    fail();
+                }
+                Function *fn = &functions[current_scope];
+                if (!stmt->left != !fn->node->returns) {
+                    printf("Semantic error: '%s' %s\n", fn->node->value,
+                           fn->node->returns ? "must return a value" : "does not return a value");
+                    fail();
+                }
+                if (stmt->left) compileExpression(stmt->left);
+                emitBytecode(BC_RET);
+                break;
+            }
+            default:
+                printf("Unknown AST node type\n");
+                fail();
+        }
+    }
+}
+
+// The program, then every function, once collectFunctions has taken the
+// functions out. Returns the number of words.
+int compileBytecode(ASTNode *program) {
+    bytecode_count = 0;
+    planInlining(program);   // Only for its checks
+
+    compileStatements(program);
+    for (int v = 0; v < symbol_count; v++) {
+        if (symbol_scope[v] >= 0) continue;
+        emitBytecode(BC_LOAD);
+        emitBytecode(v);
+        emitBytecode(BC_OUT);
+    }
+    emitBytecode(BC_HALT);
+
+    for (int f = 0; f < function_count; f++) {
+        current_scope = f;
+        function_entry[f] = bytecode_count;
+        compileStatements(functions[f].node->body);
+        if (functions[f].node->returns) {
+            emitBytecode(BC_CONST);
+            emitBytecode(0);
+        }
+        emitBytecode(BC_RET);
+    }
+    current_scope = -1;
+    return bytecode_count;
+}
+
+void printOutput(unsigned value) {
+    for (int i = int_bytes - 1; i >= 0; i--) {
+        unsigned byte = value >> (8 * i) & 0xFF;
+        printf("Output: %3u ($%02x)\n", byte, byte);
+    }
+}
+
+// Run the compiled program. Returns the number of bytecode instructions
+// executed, -1 when the program did not halt within vm_max_steps, or -2
+// when it needed more than VM_STACK values on the stack.
+long runBytecode() {
+    unsigned vars[MAX_SYMBOLS] = {0}, stack[VM_STACK];
+    int calls[MAX_FUNCTIONS + 1];
+    int *pc = bytecode, sp = 0, depth = 0;
+    long steps = 0;
+    unsigned a, b;
+
+#if defined(__GNUC__)
+    // Computed goto: one indirect jump per instruction, at the end of each
+    static void *dispatch[] = {
+        &&op_const, &&op_load, &&op_store, &&op_add, &&op_sub, &&op_pop, &&op_out,
+        &&op_jump, &&op_jz, &&op_jnz, &&op_je, &&op_jne, &&op_jlt, &&op_jge,
+        &&op_jgt, &&op_jle, &&op_call, &&op_ret, &&op_halt
+    };
+#define CASE(label, op) label:
+#define NEXT() do { if (++steps > vm_max_steps) return -1; goto *dispatch[*pc++]; } while (0)
+    NEXT();
+#else
+#define CASE(label, op) case op:
+#define NEXT() continue
+    for (;;) {
+        if (++steps > vm_max_steps) return -1;
+        switch (*pc++) {
+#endif
+
+    // Only these two push, and calls nest inside expressions, so the depth
+    // is checked here rather than worked out from the program
+    CASE(op_const, BC_CONST) if (sp == VM_STACK) return -2; stack[sp++] = (unsigned)*pc++; NEXT();
+    CASE(op_load, BC_LOAD) if (sp == VM_STACK) return -2; stack[sp++] = vars[*pc++]; NEXT();
+    CASE(op_store, BC_STORE) vars[*pc++] = stack[--sp]; NEXT();
+    CASE(op_add, BC_ADD) sp--; stack[sp - 1] = (stack[sp - 1] + stack[sp]) & int_mask; NEXT();
+    CASE(op_sub, BC_SUB) sp--; stack[sp - 1] = (stack[sp - 1] - stack[sp]) & int_mask; NEXT();
+    CASE(op_pop, BC_POP) sp--; NEXT();
+    CASE(op_out, BC_OUT) printOutput(stack[--sp]); NEXT();
+    CASE(op_jump, BC_JUMP) pc = bytecode + *pc; NEXT();
+    CASE(op_jz, BC_JZ) pc = stack[--sp] == 0 ? bytecode + *pc : pc + 1; NEXT();
+    CASE(op_jnz, BC_JNZ) pc = stack[--sp] != 0 ? bytecode + *pc : pc + 1; NEXT();
+    CASE(op_je, BC_JE) b = stack[--sp]; a = stack[--sp]; pc = a == b ? bytecode + *pc : pc + 1; NEXT();
+    CASE(op_jne, BC_JNE) b = stack[--sp]; a = stack[--sp]; pc = a != b ? bytecode + *pc : pc + 1; NEXT();
+    CASE(op_jlt, BC_JLT) b = stack[--sp]; a = stack[--sp]; pc = a < b ? bytecode + *pc : pc + 1; NEXT();
+    CASE(op_jge, BC_JGE) b = stack[--sp]; a = stack[--sp]; pc = a >= b ? bytecode + *pc : pc + 1; NEXT();
+    CASE(op_jgt, BC_JGT) b = stack[--sp]; a = stack[--sp]; pc = a > b ? bytecode + *pc : pc + 1; NEXT();
+    CASE(op_jle, BC_JLE) b = stack[--sp]; a = stack[--sp]; pc = a <= b ? bytecode + *pc : pc + 1; NEXT();
+    CASE(op_call, BC_CALL) {
+        Function *fn = &functions[*pc++];
+        memset(vars + fn->first_symbol, 0, (fn->result - fn->first_symbol + 1) * sizeof(unsigned));
+        for (int i = fn->params - 1; i >= 0; i--) vars[fn->first_symbol + i] = stack[--sp];
+        calls[depth++] = pc - bytecode;
+        pc = bytecode + function_entry[fn - functions];
+        NEXT();
+    }
+    CASE(op_ret, BC_RET) pc = bytecode + calls[--depth]; NEXT();
+    CASE(op_halt, BC_HALT) return steps;
+
+#if !defined(__GNUC__)
+        }
+    }
+#endif
+#undef CASE
+#undef NEXT
+}
+
+void freeAST(ASTNode *node) {
+    while (node) {
+        ASTNode *next = node->next;
+        freeAST(node->left);
+        freeAST(node->right);
+        freeAST(node->condition);
+        freeAST(node->body);
+        free(node);
+        node = next;
+    }
+}
+
+// Parse, compile and run one program. Returns 0 if it had an error or did
+// not halt. After an error the rest of its AST is not freed.
+int runProgram(const char *filename) {
+    jmp_buf error;
+
+    input_file = fopen(filename, "r");
+    if (!input_file) {
+        perror(filename);
+        return 0;
+    }
+    symbol_count = function_count = nesting = 0;
+    current_scope = -1;
+    if (setjmp(error)) {
+        on_error = NULL;
+        if (input_file) fclose(input_file);
+        input_file = NULL;
+        return 0;
+    }
+    on_error = &error;
+
+    getNextToken(input_file, &current_token);
+    ASTNode *program = collectFunctions(parseProgram());
+    fclose(input_file);
+    input_file = NULL;
+    compileBytecode(program);
+    on_error = NULL;
+
+    long steps = runBytecode();
+    if (steps == -1) printf("Did not halt after %ld steps\n", vm_max_steps);
+    if (steps == -2) printf("Stack overflow: more than %d values on the stack\n", VM_STACK);
+
+    freeAST(program);
+    for (int f = 0; f < function_count; f++) {
+        functions[f].node->next = NULL;   // Still points into the program
+        freeAST(functions[f].node);
+    }
+    return steps >= 0;
+}
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Run every program, with a "==> name <==" line before each when there
+// are several, then report the time taken on stderr
+int runPrograms(char **filenames, int count) {
+    double start = now();
+    int halted = 0;
+    for (int i = 0; i < count; i++) {
+        if (count > 1) printf("==> %s <==\n", filenames[i]);
+        halted += runProgram(filenames[i]);
+    }
+    double seconds = now() - start;
+    if (count > 1) {
+        fprintf(stderr, "%d programs in %.3f s (%.0f per second)", count, seconds,
+                seconds > 0 ? count / seconds : 0.0);
+        if (halted < count) fprintf(stderr, ", %d failed or did not halt", count - halted);
+        fprintf(stderr, "\n");
+    }
+    free(bytecode);
+    return halted == count ? 0 : 1;
+}
+
+// Main Function
+int main(int argc, char *argv[]) {
+    const char *filename = "input.txt";
+    char **filenames = malloc(argc * sizeof(char *));
+    int dump_ir = 0, stats = 0, memory_map = 0, run = 0, file_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-run") == 0) run = 1;
+        else if (strcmp(argv[i], "-steps") == 0 && i + 1 < argc) vm_max_steps = atol(argv[++i]);
+        else if (strcmp(argv[i], "-O0") == 0) optimize = 0;
+        else if (strcmp(argv[i], "-O1") == 0) optimize = 1;
+        else if (strcmp(argv[i], "-dump-ir") == 0) dump_ir = 1;
+        else if (strcmp(argv[i], "-stats") == 0) stats = 1;
+        else if (strcmp(argv[i], "-no-inline") == 0) inline_calls = 0;
+        else if (strcmp(argv[i], "-memory-map") == 0) memory_map = 1;
+        else if (strcmp(argv[i], "-int") == 0 && i + 1 < argc) {
+            int bits = atoi(argv[++i]);
+            if (bits != 8 && bits != 16 && bits != 32) {
+                fprintf(stderr, "-int takes 8, 16 or 32\n");
+                return 1;
+            }
+            int_bytes = bits / 8;
+            int_mask = bits == 32 ? 0xFFFFFFFFu : (1u << bits) - 1;
+        }
+        else filename = filenames[file_count++] = argv[i];
+    }
+
+    if (run) {
+        if (file_count == 0) filenames[file_count++] = (char *)filename;
+        int status = runPrograms(filenames, file_count);
+        free(filenames);
+        return status;
+    }
+    free(filenames);
+
+    input_file = fopen(filename, "r");
+    if (!input_file) {
+        perror("Failed to open input file");
+        return 1;
+    }
+
+    getNextToken(input_file, &current_token);
+
+    ASTNode *program = parseProgram();
+    buildProgram(program);
+
+    int before = lowerIR(NULL, NULL);
+    if (optimize) optimizeIR();
+    if (dump_ir) dumpIR(stderr);
+    int after = lowerIR(stdout, memory_map ? stderr : NULL);
 
-    ASTNode *program = parseStatement();
-    generateCode(program);
+    if (stats) fprintf(stderr, "instructions: %d before optimization, %d after\n", before, after);
 
     fclose(input_file);
     return 0;
@@ -0,0 +1,698 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Superoptimizer for the 8-bit CPU
+//
+// Tries every sequence of instructions up to a given length and keeps the
+// one that computes an idiom, such as negating A, in the fewest cycles. A
+// candidate is first run on a few inputs, and one that gets them all right
+// is then run on every value of its input registers and both flags, against
+// the model of rtl/alu.v below. Sequences may jump forward within
+// themselves; their cost is the slowest path over all inputs.
+//
+// The search uses A, B and C: D to G behave like C, and the sequences are
+// short enough that one scratch register is all they need. Memory operands
+// are left out too: push and pop can keep values aside.
+//
+//   ./superopt [-j threads] [-length N] [idiom ...]    table of idioms
+//   ./superopt -c > superopt.h                          add_constant[] for assemblycode.c
+
+#define MAX_LENGTH     8
+#define MAX_OPS        96
+#define MAX_THREADS    256
+#define MAX_CONSTANTS  6
+#define MAX_CODE       2      // Instructions in an add_constant[] entry
+#define QUICK_INPUTS   8
+#define PAIR_STATES    64     // Random machine states that must agree to call a pair redundant
+
+// T-states of each instruction, from the next_state equations in
+// rtl/cpu_control.v: T1 and T2 fetch it, then one per state until
+// STATE_NEXT
+#define ALU_CYCLES  5
+#define CMP_CYCLES  4
+#define MOV_CYCLES  6
+#define LDI_CYCLES  5
+#define PUSH_CYCLES 5
+#define POP_CYCLES  6
+#define JUMP_CYCLES 5
+
+enum { REG_A, REG_B, REG_C, REG_COUNT };
+#define REG(r)  (1 << (r))
+#define FLAG_Z  (1 << REG_COUNT)
+#define FLAG_C  (2 << REG_COUNT)
+#define ALL_REGISTERS (REG(REG_A) | REG(REG_B) | REG(REG_C))
+
+// Numbered as in rtl/parameters.v
+enum { ALU_ADD, ALU_SUB, ALU_INC, ALU_DEC, ALU_AND, ALU_OR, ALU_XOR, ALU_ADC };
+enum { JMP_JMP, JMP_JZ, JMP_JNZ, JMP_JC, JMP_JNC };
+
+const char *alu_names[] = {"add", "sub", "inc", "dec", "and", "or", "xor", "adc"};
+const char *jump_names[] = {"jmp", "jz", "jnz", "jc", "jnc"};
+const char register_names[] = "ABC";
+
+typedef enum { OP_ALU, OP_CMP, OP_MOV, OP_LDI, OP_PUSH, OP_POP, OP_JUMP } OpKind;
+
+typedef struct {
+    OpKind kind;
+    int mode;         // ALU mode or jump condition
+    int dst, src;
+    int constant;
+    int reads, writes;
+    int cycles, bytes;
+} Op;
+
+typedef struct {
+    unsigned char reg[REG_COUNT];
+    unsigned char zero, carry;
+    unsigned char stack[MAX_LENGTH];
+    int sp;
+} Machine;
+
+typedef struct {
+    int length;
+    int ops[MAX_LENGTH];
+    int target[MAX_LENGTH];   // Where a jump goes, up to 'length' for the end
+} Sequence;
+
+// Idioms
+//
+// 'reference' computes the expected outputs in place from the inputs.
+// Inputs that are neither outputs nor scratch must come out unchanged;
+// flags that are not outputs may change.
+
+typedef struct {
+    const char *name;
+    const char *description;
+    int inputs, outputs, scratch;
+    void (*reference)(Machine *m, int k);
+    int k;
+    int branches;     // Whether the sequence may jump
+} Goal;
+
+void clear(Machine *m, int k) {
+    (void)k;
+    m->reg[REG_A] = 0;
+}
+
+void clearZero(Machine *m, int k) {
+    (void)k;
+    m->reg[REG_A] = 0;
+    m->zero = 1;
+}
+
+void complement(Machine *m, int k) {
+    (void)k;
+    m->reg[REG_A] = ~m->reg[REG_A];
+}
+
+void negate(Machine *m, int k) {
+    (void)k;
+    m->reg[REG_A] = -m->reg[REG_A];
+}
+
+void times(Machine *m, int k) {
+    m->reg[REG_A] = m->reg[REG_A] * k;
+}
+
+void addConstant(Machine *m, int k) {
+    m->reg[REG_A] = m->reg[REG_A] + k;
+}
+
+void minimum(Machine *m, int k) {
+    (void)k;
+    if (m->reg[REG_B] < m->reg[REG_A]) m->reg[REG_A] = m->reg[REG_B];
+}
+
+void maximum(Machine *m, int k) {
+    (void)k;
+    if (m->reg[REG_B] > m->reg[REG_A]) m->reg[REG_A] = m->reg[REG_B];
+}
+
+void swap(Machine *m, int k) {
+    (void)k;
+    unsigned char a = m->reg[REG_A];
+    m->reg[REG_A] = m->reg[REG_B];
+    m->reg[REG_B] = a;
+}
+
+void reverseSubtract(Machine *m, int k) {
+    (void)k;
+    m->reg[REG_A] = m->reg[REG_B] - m->reg[REG_A];
+}
+
+void isZero(Machine *m, int k) {
+    (void)k;
+    m->reg[REG_A] = m->reg[REG_A] == 0;
+}
+
+#define UNARY  REG(REG_A), REG(REG_A), REG(REG_B) | REG(REG_C)
+#define BINARY REG(REG_A) | REG(REG_B), REG(REG_A), REG(REG_C)
+
+Goal idioms[] = {
+    {"clear", "A = 0", UNARY, clear, 0, 1},
+    {"clear-zero", "A = 0 and set zero", REG(REG_A), REG(REG_A) | FLAG_Z, REG(REG_B) | REG(REG_C), clearZero, 0, 1},
+    {"not", "A = ~A", UNARY, complement, 0, 1},
+    {"negate", "A = -A", UNARY, negate, 0, 1},
+    {"times2", "A = 2 * A", UNARY, times, 2, 1},
+    {"times3", "A = 3 * A", UNARY, times, 3, 1},
+    {"times4", "A = 4 * A", UNARY, times, 4, 1},
+    {"times5", "A = 5 * A", UNARY, times, 5, 1},
+    {"times6", "A = 6 * A", UNARY, times, 6, 1},
+    {"is-zero", "A = 1 if A is 0, else 0", UNARY, isZero, 0, 1},
+    {"min", "A = min(A, B), unsigned", BINARY, minimum, 0, 1},
+    {"max", "A = max(A, B), unsigned", BINARY, maximum, 0, 1},
+    {"rsub", "A = B - A", REG(REG_A) | REG(REG_B), REG(REG_A), REG(REG_B) | REG(REG_C), reverseSubtract, 0, 1},
+    {"swap", "swap A and B", REG(REG_A) | REG(REG_B), REG(REG_A) | REG(REG_B), REG(REG_C), swap, 0, 1},
+};
+#define IDIOM_COUNT ((int)(sizeof(idioms) / sizeof(idioms[0])))
+
+// Model of rtl/alu.v: the 9-bit sum or difference sets carry, and, or and
+// xor leave it as it was. cmp is a sub that only sets the flags.
+void alu(Machine *m, int mode, int keep) {
+    int a = m->reg[REG_A], b = m->reg[REG_B], r;
+    switch (mode) {
+        case ALU_ADD: r = a + b; break;
+        case ALU_SUB: r = a - b; break;
+        case ALU_INC: r = a + 1; break;
+        case ALU_DEC: r = a - 1; break;
+        case ALU_AND: r = a & b; break;
+        case ALU_OR:  r = a | b; break;
+        case ALU_XOR: r = a ^ b; break;
+        default:      r = a + b + m->carry; break;
+    }
+    if (mode < ALU_AND || mode == ALU_ADC) m->carry = (r >> 8) & 1;
+    m->zero = (r & 0xFF) == 0;
+    if (!keep) m->reg[REG_A] = r;
+}
+
+int taken(int condition, const Machine *m) {
+    switch (condition) {
+        case JMP_JZ:  return m->zero;
+        case JMP_JNZ: return !m->zero;
+        case JMP_JC:  return m->carry;
+        case JMP_JNC: return !m->carry;
+        default:      return 1;
+    }
+}
+
+// Run 'length' instructions of 'ops' and return the cycles taken
+int run(const Op *ops, const int *sequence, const int *target, int length, Machine *m) {
+    int cycles = 0;
+    for (int pc = 0; pc < length; pc++) {
+        const Op *op = &ops[sequence[pc]];
+        cycles += op->cycles;
+        switch (op->kind) {
+            case OP_ALU:  alu(m, op->mode, 0); break;
+            case OP_CMP:  alu(m, ALU_SUB, 1); break;
+            case OP_MOV:  m->reg[op->dst] = m->reg[op->src]; break;
+            case OP_LDI:  m->reg[op->dst] = op->constant; break;
+            case OP_PUSH: m->stack[m->sp++] = m->reg[op->src]; break;
+            case OP_POP:  m->reg[op->dst] = m->stack[--m->sp]; break;
+            case OP_JUMP:
+                if (taken(op->mode, m)) pc = target[pc] - 1;
+                break;
+        }
+    }
+    return cycles;
+}
+
+// Search State
+
+typedef struct {
+    const Goal *goal;
+    Op ops[MAX_OPS];
+    int op_count;
+    char redundant[MAX_OPS][MAX_OPS];   // ops[i] then ops[j] can be done faster
+    Machine quick[QUICK_INPUTS], quick_expected[QUICK_INPUTS];
+    int checked;      // Registers and flags compared with the reference
+
+    pthread_mutex_t lock;
+    int length;       // Being searched
+    int next_first;   // Next first instruction to hand out
+    int found;
+    Sequence best;
+    int best_cycles, best_bytes;
+    long tried, verified;
+} Search;
+
+typedef struct {
+    int reached;
+    int defined;   // Registers written on every path so far
+    int depth;     // Bytes pushed, -1 when paths disagree
+} Point;
+
+typedef struct {
+    Search *search;
+    int first;
+    int bound;     // Cycles of the best sequence known
+    Sequence sequence;
+    long tried, verified;
+} Worker;
+
+void addOp(Search *s, OpKind kind, int mode, int dst, int src, int constant, int reads, int writes) {
+    static const int cycles[] = {ALU_CYCLES, CMP_CYCLES, MOV_CYCLES, LDI_CYCLES,
+                                 PUSH_CYCLES, POP_CYCLES, JUMP_CYCLES};
+    Op *op = &s->ops[s->op_count++];
+    op->kind = kind;
+    op->mode = mode;
+    op->dst = dst;
+    op->src = src;
+    op->constant = constant;
+    op->reads = reads;
+    op->writes = writes;
+    op->cycles = cycles[kind];
+    op->bytes = kind == OP_LDI || kind == OP_JUMP ? 2 : 1;
+}
+
+// The instructions a goal may use. ldi takes 0, 1, 255 and the constants
+// the goal itself mentions.
+void buildOps(Search *s) {
+    const Goal *g = s->goal;
+    int usable = (g->inputs | g->outputs | g->scratch) & ALL_REGISTERS;
+    int writable = (g->outputs | g->scratch) & ALL_REGISTERS;
+    int constants[MAX_CONSTANTS], constant_count = 0;
+    int wanted[] = {0, 1, 255, g->k & 0xFF, -g->k & 0xFF};
+
+    for (int i = 0; i < 5; i++) {
+        int seen = 0;
+        for (int j = 0; j < constant_count; j++) seen |= constants[j] == wanted[i];
+        if (!seen) constants[constant_count++] = wanted[i];
+    }
+
+    s->op_count = 0;
+    if (writable & REG(REG_A)) {
+        for (int mode = ALU_ADD; mode <= ALU_ADC; mode++) {
+            int unary = mode == ALU_INC || mode == ALU_DEC;
+            if (!unary && !(usable & REG(REG_B))) continue;
+            addOp(s, OP_ALU, mode, REG_A, 0, 0, unary ? REG(REG_A) : REG(REG_A) | REG(REG_B), REG(REG_A));
+        }
+    }
+    if (usable & REG(REG_B)) addOp(s, OP_CMP, 0, 0, 0, 0, REG(REG_A) | REG(REG_B), 0);
+    for (int d = 0; d < REG_COUNT; d++) {
+        if (!(writable & REG(d))) continue;
+        for (int r = 0; r < REG_COUNT; r++) {
+            if (r != d && (usable & REG(r))) addOp(s, OP_MOV, 0, d, r, 0, REG(r), REG(d));
+        }
+        for (int c = 0; c < constant_count; c++) addOp(s, OP_LDI, 0, d, 0, constants[c], 0, REG(d));
+    }
+    for (int r = 0; r < REG_COUNT; r++) {
+        if (usable & REG(r)) addOp(s, OP_PUSH, 0, 0, r, 0, REG(r), 0);
+        if (writable & REG(r)) addOp(s, OP_POP, 0, r, 0, 0, 0, REG(r));
+    }
+    if (g->branches) {
+        for (int c = JMP_JMP; c <= JMP_JNC; c++) addOp(s, OP_JUMP, c, 0, 0, 0, 0, 0);
+    }
+}
+
+int sameState(const Machine *a, const Machine *b) {
+    return memcmp(a->reg, b->reg, sizeof(a->reg)) == 0 && a->zero == b->zero && a->carry == b->carry &&
+           a->sp == b->sp && memcmp(a->stack, b->stack, a->sp) == 0;
+}
+
+// A pair of instructions is redundant when nothing, or a single instruction
+// that is no slower, no longer and reads nothing more, leaves every register,
+// flag and stack byte as the pair does. No optimal sequence needs one next to
+// each other, unless something jumps between them. The pair is only tried on
+// random states, which at worst makes the search miss a sequence.
+void findRedundantPairs(Search *s) {
+    Machine states[PAIR_STATES], after[PAIR_STATES], m;
+    unsigned seed = 12345;
+
+    for (int i = 0; i < PAIR_STATES; i++) {
+        for (int r = 0; r < REG_COUNT; r++) states[i].reg[r] = rand_r(&seed);
+        states[i].zero = rand_r(&seed) & 1;
+        states[i].carry = rand_r(&seed) & 1;
+        for (int j = 0; j < MAX_LENGTH; j++) states[i].stack[j] = rand_r(&seed);
+        states[i].sp = MAX_LENGTH / 2;
+    }
+
+    memset(s->redundant, 0, sizeof(s->redundant));
+    for (int p = 0; p < s->op_count; p++) {
+        for (int q = 0; q < s->op_count; q++) {
+            const Op *a = &s->ops[p], *b = &s->ops[q];
+            if (a->kind == OP_JUMP || b->kind == OP_JUMP) continue;
+            int pair[2] = {p, q};
+            int reads = a->reads | (b->reads & ~a->writes);
+            for (int i = 0; i < PAIR_STATES; i++) {
+                after[i] = states[i];
+                run(s->ops, pair, NULL, 2, &after[i]);
+            }
+            for (int r = -1; r < s->op_count && !s->redundant[p][q]; r++) {
+                const Op *c = r >= 0 ? &s->ops[r] : NULL;
+                if (c && (c->kind == OP_JUMP || c->cycles > a->cycles + b->cycles ||
+                          c->bytes > a->bytes + b->bytes || (c->reads & ~reads))) continue;
+                int same = 1;
+                for (int i = 0; i < PAIR_STATES && same; i++) {
+                    m = states[i];
+                    run(s->ops, &r, NULL, c ? 1 : 0, &m);
+                    same = sameState(&m, &after[i]);
+                }
+                s->redundant[p][q] = same;
+            }
+        }
+    }
+}
+
+void startMachine(Machine *m, int a, int b, int flags) {
+    memset(m, 0, sizeof(*m));
+    m->reg[REG_A] = a;
+    m->reg[REG_B] = b;
+    m->reg[REG_C] = 0xa5;
+    m->zero = flags & 1;
+    m->carry = flags >> 1;
+}
+
+int matches(const Search *s, const Machine *m, const Machine *expected) {
+    for (int r = 0; r < REG_COUNT; r++) {
+        if ((s->checked & REG(r)) && m->reg[r] != expected->reg[r]) return 0;
+    }
+    if ((s->checked & FLAG_Z) && m->zero != expected->zero) return 0;
+    if ((s->checked & FLAG_C) && m->carry != expected->carry) return 0;
+    return 1;
+}
+
+void prepareQuickInputs(Search *s) {
+    static const int inputs[QUICK_INPUTS][3] = {
+        {0, 0, 0}, {255, 1, 3}, {1, 255, 1}, {128, 127, 2},
+        {37, 200, 0}, {200, 37, 3}, {255, 255, 1}, {1, 1, 2},
+    };
+    for (int i = 0; i < QUICK_INPUTS; i++) {
+        startMachine(&s->quick[i], inputs[i][0], inputs[i][1], inputs[i][2]);
+        s->quick_expected[i] = s->quick[i];
+        s->goal->reference(&s->quick_expected[i], s->goal->k);
+    }
+}
+
+// Run the sequence on every input. Returns its slowest path, or -1 if it
+// gets an input wrong.
+int verify(const Search *s, const Sequence *q) {
+    const Goal *g = s->goal;
+    int b_values = g->inputs & REG(REG_B) ? 256 : 1, worst = 0;
+    Machine m, expected;
+
+    for (int a = 0; a < 256; a++) {
+        for (int b = 0; b < b_values; b++) {
+            for (int flags = 0; flags < 4; flags++) {
+                startMachine(&m, a, b, flags);
+                expected = m;
+                g->reference(&expected, g->k);
+                int cycles = run(s->ops, q->ops, q->target, q->length, &m);
+                if (!matches(s, &m, &expected)) return -1;
+                if (cycles > worst) worst = cycles;
+            }
+        }
+    }
+    return worst;
+}
+
+int sequenceBytes(const Search *s, const Sequence *q) {
+    int bytes = 0;
+    for (int i = 0; i < q->length; i++) bytes += s->ops[q->ops[i]].bytes;
+    return bytes;
+}
+
+// Fewer cycles, then fewer bytes, then the first in search order, so that
+// the result does not depend on the number of threads
+int better(int cycles, int bytes, const Sequence *q, int best_cycles, int best_bytes, const Sequence *best) {
+    if (cycles != best_cycles) return cycles < best_cycles;
+    if (bytes != best_bytes) return bytes < best_bytes;
+    if (q->length != best->length) return q->length < best->length;
+    for (int i = 0; i < q->length; i++) {
+        if (q->ops[i] != best->ops[i]) return q->ops[i] < best->ops[i];
+        if (q->target[i] != best->target[i]) return q->target[i] < best->target[i];
+    }
+    return 0;
+}
+
+void tryCandidate(Worker *w) {
+    Search *s = w->search;
+    const Sequence *q = &w->sequence;
+    int quickest = 0;
+
+    w->tried++;
+    for (int i = 0; i < QUICK_INPUTS; i++) {
+        Machine m = s->quick[i];
+        int cycles = run(s->ops, q->ops, q->target, q->length, &m);
+        if (!matches(s, &m, &s->quick_expected[i])) return;
+        if (cycles > quickest) quickest = cycles;
+    }
+    if (quickest > w->bound) return;
+
+    w->verified++;
+    int cycles = verify(s, q);
+    if (cycles < 0 || cycles > w->bound) return;
+
+    int bytes = sequenceBytes(s, q);
+    pthread_mutex_lock(&s->lock);
+    if (!s->found || better(cycles, bytes, q, s->best_cycles, s->best_bytes, &s->best)) {
+        s->found = 1;
+        s->best = *q;
+        s->best_cycles = cycles;
+        s->best_bytes = bytes;
+    }
+    w->bound = s->best_cycles;
+    pthread_mutex_unlock(&s->lock);
+}
+
+Point merge(Point a, Point b) {
+    if (!a.reached) return b;
+    if (!b.reached) return a;
+    a.defined &= b.defined;
+    if (a.depth != b.depth) a.depth = -1;
+    return a;
+}
+
+// Choose the instruction at 'position', reached by falling through from the
+// one before and by the jumps in 'joins'. 'straight' is the cycles taken so
+// far when nothing has jumped yet, which every path then takes, or -1.
+void extend(Worker *w, int position, Point fall, const Point *joins, int straight) {
+    Search *s = w->search;
+    Point here = merge(fall, joins[position]);
+
+    if (!here.reached || here.depth < 0) return;
+    if (position == s->length) {
+        int outputs = s->goal->outputs & ALL_REGISTERS;
+        if (here.depth == 0 && (here.defined & outputs) == outputs) tryCandidate(w);
+        return;
+    }
+
+    int first = position == 0 ? w->first : 0;
+    int last = position == 0 ? w->first + 1 : s->op_count;
+    int previous = position > 0 && fall.reached && !joins[position].reached ? w->sequence.ops[position - 1] : -1;
+
+    for (int o = first; o < last; o++) {
+        const Op *op = &s->ops[o];
+        if (op->reads & ~here.defined) continue;
+        if (op->kind == OP_POP && here.depth == 0) continue;
+        if (straight >= 0 && straight + op->cycles > w->bound) continue;
+        if (previous >= 0 && s->redundant[previous][o]) continue;
+
+        Point next = here;
+        next.defined |= op->writes;
+        next.depth += op->kind == OP_PUSH ? 1 : op->kind == OP_POP ? -1 : 0;
+        w->sequence.ops[position] = o;
+        if (op->kind != OP_JUMP) {
+            extend(w, position + 1, next, joins, straight >= 0 ? straight + op->cycles : -1);
+            continue;
+        }
+
+        // Jumping to the next instruction does nothing
+        for (int target = position + 2; target <= s->length; target++) {
+            Point jumped[MAX_LENGTH + 1];
+            Point none = {0, 0, 0};
+            memcpy(jumped, joins, sizeof(jumped));
+            jumped[target] = merge(jumped[target], next);
+            w->sequence.target[position] = target;
+            extend(w, position + 1, op->mode == JMP_JMP ? none : next, jumped, -1);
+        }
+    }
+}
+
+void *searchWorker(void *arg) {
+    Worker *w = arg;
+    Search *s = w->search;
+    Point start = {1, s->goal->inputs & ALL_REGISTERS, 0};
+    Point joins[MAX_LENGTH + 1];
+
+    memset(joins, 0, sizeof(joins));
+    w->sequence.length = s->length;
+    memset(w->sequence.target, 0, sizeof(w->sequence.target));
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        w->first = s->next_first++;
+        w->bound = s->found ? s->best_cycles : INT_MAX;
+        pthread_mutex_unlock(&s->lock);
+        if (w->first >= s->op_count || (s->length == 0 && w->first > 0)) break;
+        extend(w, 0, start, joins, 0);
+    }
+    return NULL;
+}
+
+// Search sequences of up to max_length instructions for goal 'g' on
+// 'thread_count' threads. Returns 0 if none computes it.
+int superoptimize(Search *s, const Goal *g, int max_length, int thread_count) {
+    pthread_t threads[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+
+    memset(s, 0, sizeof(*s));
+    s->goal = g;
+    s->checked = g->outputs | (g->inputs & ~g->scratch);
+    pthread_mutex_init(&s->lock, NULL);
+    buildOps(s);
+    findRedundantPairs(s);
+    prepareQuickInputs(s);
+
+    for (s->length = 0; s->length <= max_length; s->length++) {
+        s->next_first = 0;
+        for (int i = 0; i < thread_count; i++) {
+            memset(&workers[i], 0, sizeof(Worker));
+            workers[i].search = s;
+            pthread_create(&threads[i], NULL, searchWorker, &workers[i]);
+        }
+        for (int i = 0; i < thread_count; i++) {
+            pthread_join(threads[i], NULL);
+            s->tried += workers[i].tried;
+            s->verified += workers[i].verified;
+        }
+    }
+    pthread_mutex_destroy(&s->lock);
+    return s->found;
+}
+
+// Output
+
+// Assembly for instruction i of the best sequence, jumps going to L<target>
+void formatOp(const Search *s, int i, char *line) {
+    const Op *op = &s->ops[s->best.ops[i]];
+    switch (op->kind) {
+        case OP_ALU:  sprintf(line, "%s", alu_names[op->mode]); break;
+        case OP_CMP:  sprintf(line, "cmp"); break;
+        case OP_MOV:  sprintf(line, "mov %c %c", register_names[op->dst], register_names[op->src]); break;
+        case OP_LDI:  sprintf(line, "ldi %c %d", register_names[op->dst], op->constant); break;
+        case OP_PUSH: sprintf(line, "push %c", register_names[op->src]); break;
+        case OP_POP:  sprintf(line, "pop %c", register_names[op->dst]); break;
+        case OP_JUMP: sprintf(line, "%s %%L%d", jump_names[op->mode], s->best.target[i]); break;
+    }
+}
+
+void printIdiom(const Search *s, int max_length) {
+    char line[32];
+    printf("; %s: %s\n", s->goal->name, s->goal->description);
+    if (!s->found) {
+        printf(";   nothing within %d instructions\n\n", max_length);
+        return;
+    }
+    printf(";   %d cycles, %d bytes\n", s->best_cycles, s->best_bytes);
+    for (int i = 0; i <= s->best.length; i++) {
+        for (int j = 0; j < s->best.length; j++) {
+            if (s->ops[s->best.ops[j]].kind == OP_JUMP && s->best.target[j] == i) {
+                printf("L%d:\n", i);
+                break;
+            }
+        }
+        if (i == s->best.length) break;
+        formatOp(s, i, line);
+        printf("    %s\n", line);
+    }
+    printf("\n");
+}
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+void report(const Search *s, double seconds) {
+    fprintf(stderr, "%-12s %12ld tried %8ld verified %8.2f s\n", s->goal->name, s->tried, s->verified, seconds);
+}
+
+// A + k for every k, changing nothing but B and the flags. ldi B k and add
+// always do it in 10 cycles, and three instructions take at least 12.
+// Branches are left out, as the code generator cannot place their labels.
+void printAddTable(int thread_count) {
+    Search *s = malloc(sizeof(Search));
+    char line[32];
+    double start = now();
+    long tried = 0, verified = 0;
+
+    printf("// Generated by superopt.c, do not edit: ./superopt -c > superopt.h\n");
+    printf("//\n");
+    printf("// add_constant[k] is the fastest code to add k to A. It changes B and the\n");
+    printf("// flags at most.\n\n");
+    printf("#define MAX_CODE %d\n\n", MAX_CODE);
+    printf("typedef struct {\n");
+    printf("    int cycles;\n");
+    printf("    int bytes;\n");
+    printf("    const char *code[MAX_CODE + 1];\n");
+    printf("} Replacement;\n\n");
+    printf("static const Replacement add_constant[256] = {\n");
+    for (int k = 0; k < 256; k++) {
+        char name[16], description[32];
+        sprintf(name, "add%d", k);
+        sprintf(description, "A = A + %d", k);
+        Goal g = {name, description, REG(REG_A), REG(REG_A), REG(REG_B), addConstant, k, 0};
+
+        if (!superoptimize(s, &g, MAX_CODE, thread_count)) {
+            fprintf(stderr, "superopt: nothing computes A + %d\n", k);
+            exit(1);
+        }
+        tried += s->tried;
+        verified += s->verified;
+        printf("    {%d, %d, {", s->best_cycles, s->best_bytes);
+        for (int i = 0; i < s->best.length; i++) {
+            formatOp(s, i, line);
+            printf("\"%s\", ", line);
+        }
+        printf("NULL}},\n");
+    }
+    printf("};\n");
+    fprintf(stderr, "%-12s %12ld tried %8ld verified %8.2f s\n", "add_constant", tried, verified, now() - start);
+    free(s);
+}
+
+// Main Function
+int main(int argc, char *argv[]) {
+    int thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_length = 5, table = 0, name_count = 0;
+    char **names = malloc(argc * sizeof(char *));
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) thread_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-length") == 0 && i + 1 < argc) max_length = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0) table = 1;
+        else names[name_count++] = argv[i];
+    }
+    if (thread_count < 1) thread_count = 1;
+    if (thread_count > MAX_THREADS) thread_count = MAX_THREADS;
+    if (max_length < 1 || max_length > MAX_LENGTH) {
+        fprintf(stderr, "superopt: -length must be 1 to %d\n", MAX_LENGTH);
+        return 1;
+    }
+
+    if (table) {
+        printAddTable(thread_count);
+        free(names);
+        return 0;
+    }
+
+    Search *s = malloc(sizeof(Search));
+    for (int i = 0; i < IDIOM_COUNT; i++) {
+        int wanted = name_count == 0;
+        for (int j = 0; j < name_count; j++) wanted |= strcmp(names[j], idioms[i].name) == 0;
+        if (!wanted) continue;
+        double start = now();
+        superoptimize(s, &idioms[i], max_length, thread_count);
+        printIdiom(s, max_length);
+        fflush(stdout);
+        report(s, now() - start);
+    }
+    free(s);
+    free(names);
+    return 0;
+}
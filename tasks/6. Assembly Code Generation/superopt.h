@@ -0,0 +1,271 @@
+// Generated by superopt.c, do not edit: ./superopt -c > superopt.h
+//
+// add_constant[k] is the fastest code to add k to A. It changes B and the
+// flags at most.
+
+#define MAX_CODE 2
+
+typedef struct {
+    int cycles;
+    int bytes;
+    const char *code[MAX_CODE + 1];
+} Replacement;
+
+static const Replacement add_constant[256] = {
+    {0, 0, {NULL}},
+    {5, 1, {"inc", NULL}},
+    {10, 2, {"inc", "inc", NULL}},
+    {10, 3, {"ldi B 3", "add", NULL}},
+    {10, 3, {"ldi B 4", "add", NULL}},
+    {10, 3, {"ldi B 5", "add", NULL}},
+    {10, 3, {"ldi B 6", "add", NULL}},
+    {10, 3, {"ldi B 7", "add", NULL}},
+    {10, 3, {"ldi B 8", "add", NULL}},
+    {10, 3, {"ldi B 9", "add", NULL}},
+    {10, 3, {"ldi B 10", "add", NULL}},
+    {10, 3, {"ldi B 11", "add", NULL}},
+    {10, 3, {"ldi B 12", "add", NULL}},
+    {10, 3, {"ldi B 13", "add", NULL}},
+    {10, 3, {"ldi B 14", "add", NULL}},
+    {10, 3, {"ldi B 15", "add", NULL}},
+    {10, 3, {"ldi B 16", "add", NULL}},
+    {10, 3, {"ldi B 17", "add", NULL}},
+    {10, 3, {"ldi B 18", "add", NULL}},
+    {10, 3, {"ldi B 19", "add", NULL}},
+    {10, 3, {"ldi B 20", "add", NULL}},
+    {10, 3, {"ldi B 21", "add", NULL}},
+    {10, 3, {"ldi B 22", "add", NULL}},
+    {10, 3, {"ldi B 23", "add", NULL}},
+    {10, 3, {"ldi B 24", "add", NULL}},
+    {10, 3, {"ldi B 25", "add", NULL}},
+    {10, 3, {"ldi B 26", "add", NULL}},
+    {10, 3, {"ldi B 27", "add", NULL}},
+    {10, 3, {"ldi B 28", "add", NULL}},
+    {10, 3, {"ldi B 29", "add", NULL}},
+    {10, 3, {"ldi B 30", "add", NULL}},
+    {10, 3, {"ldi B 31", "add", NULL}},
+    {10, 3, {"ldi B 32", "add", NULL}},
+    {10, 3, {"ldi B 33", "add", NULL}},
+    {10, 3, {"ldi B 34", "add", NULL}},
+    {10, 3, {"ldi B 35", "add", NULL}},
+    {10, 3, {"ldi B 36", "add", NULL}},
+    {10, 3, {"ldi B 37", "add", NULL}},
+    {10, 3, {"ldi B 38", "add", NULL}},
+    {10, 3, {"ldi B 39", "add", NULL}},
+    {10, 3, {"ldi B 40", "add", NULL}},
+    {10, 3, {"ldi B 41", "add", NULL}},
+    {10, 3, {"ldi B 42", "add", NULL}},
+    {10, 3, {"ldi B 43", "add", NULL}},
+    {10, 3, {"ldi B 44", "add", NULL}},
+    {10, 3, {"ldi B 45", "add", NULL}},
+    {10, 3, {"ldi B 46", "add", NULL}},
+    {10, 3, {"ldi B 47", "add", NULL}},
+    {10, 3, {"ldi B 48", "add", NULL}},
+    {10, 3, {"ldi B 49", "add", NULL}},
+    {10, 3, {"ldi B 50", "add", NULL}},
+    {10, 3, {"ldi B 51", "add", NULL}},
+    {10, 3, {"ldi B 52", "add", NULL}},
+    {10, 3, {"ldi B 53", "add", NULL}},
+    {10, 3, {"ldi B 54", "add", NULL}},
+    {10, 3, {"ldi B 55", "add", NULL}},
+    {10, 3, {"ldi B 56", "add", NULL}},
+    {10, 3, {"ldi B 57", "add", NULL}},
+    {10, 3, {"ldi B 58", "add", NULL}},
+    {10, 3, {"ldi B 59", "add", NULL}},
+    {10, 3, {"ldi B 60", "add", NULL}},
+    {10, 3, {"ldi B 61", "add", NULL}},
+    {10, 3, {"ldi B 62", "add", NULL}},
+    {10, 3, {"ldi B 63", "add", NULL}},
+    {10, 3, {"ldi B 64", "add", NULL}},
+    {10, 3, {"ldi B 65", "add", NULL}},
+    {10, 3, {"ldi B 66", "add", NULL}},
+    {10, 3, {"ldi B 67", "add", NULL}},
+    {10, 3, {"ldi B 68", "add", NULL}},
+    {10, 3, {"ldi B 69", "add", NULL}},
+    {10, 3, {"ldi B 70", "add", NULL}},
+    {10, 3, {"ldi B 71", "add", NULL}},
+    {10, 3, {"ldi B 72", "add", NULL}},
+    {10, 3, {"ldi B 73", "add", NULL}},
+    {10, 3, {"ldi B 74", "add", NULL}},
+    {10, 3, {"ldi B 75", "add", NULL}},
+    {10, 3, {"ldi B 76", "add", NULL}},
+    {10, 3, {"ldi B 77", "add", NULL}},
+    {10, 3, {"ldi B 78", "add", NULL}},
+    {10, 3, {"ldi B 79", "add", NULL}},
+    {10, 3, {"ldi B 80", "add", NULL}},
+    {10, 3, {"ldi B 81", "add", NULL}},
+    {10, 3, {"ldi B 82", "add", NULL}},
+    {10, 3, {"ldi B 83", "add", NULL}},
+    {10, 3, {"ldi B 84", "add", NULL}},
+    {10, 3, {"ldi B 85", "add", NULL}},
+    {10, 3, {"ldi B 86", "add", NULL}},
+    {10, 3, {"ldi B 87", "add", NULL}},
+    {10, 3, {"ldi B 88", "add", NULL}},
+    {10, 3, {"ldi B 89", "add", NULL}},
+    {10, 3, {"ldi B 90", "add", NULL}},
+    {10, 3, {"ldi B 91", "add", NULL}},
+    {10, 3, {"ldi B 92", "add", NULL}},
+    {10, 3, {"ldi B 93", "add", NULL}},
+    {10, 3, {"ldi B 94", "add", NULL}},
+    {10, 3, {"ldi B 95", "add", NULL}},
+    {10, 3, {"ldi B 96", "add", NULL}},
+    {10, 3, {"ldi B 97", "add", NULL}},
+    {10, 3, {"ldi B 98", "add", NULL}},
+    {10, 3, {"ldi B 99", "add", NULL}},
+    {10, 3, {"ldi B 100", "add", NULL}},
+    {10, 3, {"ldi B 101", "add", NULL}},
+    {10, 3, {"ldi B 102", "add", NULL}},
+    {10, 3, {"ldi B 103", "add", NULL}},
+    {10, 3, {"ldi B 104", "add", NULL}},
+    {10, 3, {"ldi B 105", "add", NULL}},
+    {10, 3, {"ldi B 106", "add", NULL}},
+    {10, 3, {"ldi B 107", "add", NULL}},
+    {10, 3, {"ldi B 108", "add", NULL}},
+    {10, 3, {"ldi B 109", "add", NULL}},
+    {10, 3, {"ldi B 110", "add", NULL}},
+    {10, 3, {"ldi B 111", "add", NULL}},
+    {10, 3, {"ldi B 112", "add", NULL}},
+    {10, 3, {"ldi B 113", "add", NULL}},
+    {10, 3, {"ldi B 114", "add", NULL}},
+    {10, 3, {"ldi B 115", "add", NULL}},
+    {10, 3, {"ldi B 116", "add", NULL}},
+    {10, 3, {"ldi B 117", "add", NULL}},
+    {10, 3, {"ldi B 118", "add", NULL}},
+    {10, 3, {"ldi B 119", "add", NULL}},
+    {10, 3, {"ldi B 120", "add", NULL}},
+    {10, 3, {"ldi B 121", "add", NULL}},
+    {10, 3, {"ldi B 122", "add", NULL}},
+    {10, 3, {"ldi B 123", "add", NULL}},
+    {10, 3, {"ldi B 124", "add", NULL}},
+    {10, 3, {"ldi B 125", "add", NULL}},
+    {10, 3, {"ldi B 126", "add", NULL}},
+    {10, 3, {"ldi B 127", "add", NULL}},
+    {10, 3, {"ldi B 128", "add", NULL}},
+    {10, 3, {"ldi B 129", "add", NULL}},
+    {10, 3, {"ldi B 130", "add", NULL}},
+    {10, 3, {"ldi B 131", "add", NULL}},
+    {10, 3, {"ldi B 132", "add", NULL}},
+    {10, 3, {"ldi B 133", "add", NULL}},
+    {10, 3, {"ldi B 134", "add", NULL}},
+    {10, 3, {"ldi B 135", "add", NULL}},
+    {10, 3, {"ldi B 136", "add", NULL}},
+    {10, 3, {"ldi B 137", "add", NULL}},
+    {10, 3, {"ldi B 138", "add", NULL}},
+    {10, 3, {"ldi B 139", "add", NULL}},
+    {10, 3, {"ldi B 140", "add", NULL}},
+    {10, 3, {"ldi B 141", "add", NULL}},
+    {10, 3, {"ldi B 142", "add", NULL}},
+    {10, 3, {"ldi B 143", "add", NULL}},
+    {10, 3, {"ldi B 144", "add", NULL}},
+    {10, 3, {"ldi B 145", "add", NULL}},
+    {10, 3, {"ldi B 146", "add", NULL}},
+    {10, 3, {"ldi B 147", "add", NULL}},
+    {10, 3, {"ldi B 148", "add", NULL}},
+    {10, 3, {"ldi B 149", "add", NULL}},
+    {10, 3, {"ldi B 150", "add", NULL}},
+    {10, 3, {"ldi B 151", "add", NULL}},
+    {10, 3, {"ldi B 152", "add", NULL}},
+    {10, 3, {"ldi B 153", "add", NULL}},
+    {10, 3, {"ldi B 154", "add", NULL}},
+    {10, 3, {"ldi B 155", "add", NULL}},
+    {10, 3, {"ldi B 156", "add", NULL}},
+    {10, 3, {"ldi B 157", "add", NULL}},
+    {10, 3, {"ldi B 158", "add", NULL}},
+    {10, 3, {"ldi B 159", "add", NULL}},
+    {10, 3, {"ldi B 160", "add", NULL}},
+    {10, 3, {"ldi B 161", "add", NULL}},
+    {10, 3, {"ldi B 162", "add", NULL}},
+    {10, 3, {"ldi B 163", "add", NULL}},
+    {10, 3, {"ldi B 164", "add", NULL}},
+    {10, 3, {"ldi B 165", "add", NULL}},
+    {10, 3, {"ldi B 166", "add", NULL}},
+    {10, 3, {"ldi B 167", "add", NULL}},
+    {10, 3, {"ldi B 168", "add", NULL}},
+    {10, 3, {"ldi B 169", "add", NULL}},
+    {10, 3, {"ldi B 170", "add", NULL}},
+    {10, 3, {"ldi B 171", "add", NULL}},
+    {10, 3, {"ldi B 172", "add", NULL}},
+    {10, 3, {"ldi B 173", "add", NULL}},
+    {10, 3, {"ldi B 174", "add", NULL}},
+    {10, 3, {"ldi B 175", "add", NULL}},
+    {10, 3, {"ldi B 176", "add", NULL}},
+    {10, 3, {"ldi B 177", "add", NULL}},
+    {10, 3, {"ldi B 178", "add", NULL}},
+    {10, 3, {"ldi B 179", "add", NULL}},
+    {10, 3, {"ldi B 180", "add", NULL}},
+    {10, 3, {"ldi B 181", "add", NULL}},
+    {10, 3, {"ldi B 182", "add", NULL}},
+    {10, 3, {"ldi B 183", "add", NULL}},
+    {10, 3, {"ldi B 184", "add", NULL}},
+    {10, 3, {"ldi B 185", "add", NULL}},
+    {10, 3, {"ldi B 186", "add", NULL}},
+    {10, 3, {"ldi B 187", "add", NULL}},
+    {10, 3, {"ldi B 188", "add", NULL}},
+    {10, 3, {"ldi B 189", "add", NULL}},
+    {10, 3, {"ldi B 190", "add", NULL}},
+    {10, 3, {"ldi B 191", "add", NULL}},
+    {10, 3, {"ldi B 192", "add", NULL}},
+    {10, 3, {"ldi B 193", "add", NULL}},
+    {10, 3, {"ldi B 194", "add", NULL}},
+    {10, 3, {"ldi B 195", "add", NULL}},
+    {10, 3, {"ldi B 196", "add", NULL}},
+    {10, 3, {"ldi B 197", "add", NULL}},
+    {10, 3, {"ldi B 198", "add", NULL}},
+    {10, 3, {"ldi B 199", "add", NULL}},
+    {10, 3, {"ldi B 200", "add", NULL}},
+    {10, 3, {"ldi B 201", "add", NULL}},
+    {10, 3, {"ldi B 202", "add", NULL}},
+    {10, 3, {"ldi B 203", "add", NULL}},
+    {10, 3, {"ldi B 204", "add", NULL}},
+    {10, 3, {"ldi B 205", "add", NULL}},
+    {10, 3, {"ldi B 206", "add", NULL}},
+    {10, 3, {"ldi B 207", "add", NULL}},
+    {10, 3, {"ldi B 208", "add", NULL}},
+    {10, 3, {"ldi B 209", "add", NULL}},
+    {10, 3, {"ldi B 210", "add", NULL}},
+    {10, 3, {"ldi B 211", "add", NULL}},
+    {10, 3, {"ldi B 212", "add", NULL}},
+    {10, 3, {"ldi B 213", "add", NULL}},
+    {10, 3, {"ldi B 214", "add", NULL}},
+    {10, 3, {"ldi B 215", "add", NULL}},
+    {10, 3, {"ldi B 216", "add", NULL}},
+    {10, 3, {"ldi B 217", "add", NULL}},
+    {10, 3, {"ldi B 218", "add", NULL}},
+    {10, 3, {"ldi B 219", "add", NULL}},
+    {10, 3, {"ldi B 220", "add", NULL}},
+    {10, 3, {"ldi B 221", "add", NULL}},
+    {10, 3, {"ldi B 222", "add", NULL}},
+    {10, 3, {"ldi B 223", "add", NULL}},
+    {10, 3, {"ldi B 224", "add", NULL}},
+    {10, 3, {"ldi B 225", "add", NULL}},
+    {10, 3, {"ldi B 226", "add", NULL}},
+    {10, 3, {"ldi B 227", "add", NULL}},
+    {10, 3, {"ldi B 228", "add", NULL}},
+    {10, 3, {"ldi B 229", "add", NULL}},
+    {10, 3, {"ldi B 230", "add", NULL}},
+    {10, 3, {"ldi B 231", "add", NULL}},
+    {10, 3, {"ldi B 232", "add", NULL}},
+    {10, 3, {"ldi B 233", "add", NULL}},
+    {10, 3, {"ldi B 234", "add", NULL}},
+    {10, 3, {"ldi B 235", "add", NULL}},
+    {10, 3, {"ldi B 236", "add", NULL}},
+    {10, 3, {"ldi B 237", "add", NULL}},
+    {10, 3, {"ldi B 238", "add", NULL}},
+    {10, 3, {"ldi B 239", "add", NULL}},
+    {10, 3, {"ldi B 240", "add", NULL}},
+    {10, 3, {"ldi B 241", "add", NULL}},
+    {10, 3, {"ldi B 242", "add", NULL}},
+    {10, 3, {"ldi B 243", "add", NULL}},
+    {10, 3, {"ldi B 244", "add", NULL}},
+    {10, 3, {"ldi B 245", "add", NULL}},
+    {10, 3, {"ldi B 246", "add", NULL}},
+    {10, 3, {"ldi B 247", "add", NULL}},
+    {10, 3, {"ldi B 248", "add", NULL}},
+    {10, 3, {"ldi B 249", "add", NULL}},
+    {10, 3, {"ldi B 250", "add", NULL}},
+    {10, 3, {"ldi B 251", "add", NULL}},
+    {10, 3, {"ldi B 252", "add", NULL}},
+    {10, 3, {"ldi B 253", "add", NULL}},
+    {10, 2, {"dec", "dec", NULL}},
+    {5, 1, {"dec", NULL}},
+};
@@ -2,21 +2,54 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#define MAX_SYMBOLS 64
+#define MAX_FUNCTIONS 16
+#define MAX_PARAMS 6 // Arguments are passed in B to G
+#define MAX_THREADS 256
+#define COMPILER_VERSION "simplelang-7.3"
+#define BENCH_NESTING 128
+#define MAX_KINDS 32
+#define LEX_CHUNK_MIN 65536 // Smallest piece of input worth a lexer thread
+#define MAX_NAME 100        // Longest identifier or number, with its '\0'
+#define TEXT_BLOCK 65536    // Bytes of token text allocated at a time
 
 // Token Types
 typedef enum
 {
     TOKEN_INT,
     TOKEN_IF,
+    TOKEN_ELSE,
+    TOKEN_WHILE,
+    TOKEN_VOID,
+    TOKEN_RETURN,
     TOKEN_IDENTIFIER,
     TOKEN_NUMBER,
     TOKEN_ASSIGN,
     TOKEN_PLUS,
     TOKEN_MINUS,
     TOKEN_EQUAL,
+    TOKEN_NOT_EQUAL,
+    TOKEN_LESS,
+    TOKEN_GREATER,
+    TOKEN_LESS_EQUAL,
+    TOKEN_GREATER_EQUAL,
     TOKEN_LBRACE,
     TOKEN_RBRACE,
+    TOKEN_LPAREN,
+    TOKEN_RPAREN,
     TOKEN_SEMICOLON,
+    TOKEN_COMMA,
     TOKEN_EOF,
     TOKEN_UNKNOWN
 } TokenType;
@@ -25,7 +58,8 @@ typedef enum
 typedef struct
 {
     TokenType type;
-    char text[100];
+    const char *text; // A literal, or a copy in the compiler's text blocks
+    int line;
 } Token;
 
 // AST Node Types
@@ -35,8 +69,13 @@ typedef enum
     NODE_VAR_DECL,
     NODE_ASSIGN,
     NODE_EXPRESSION,
-    NODE_IF,
+    NODE_BINARY,
+    NODE_IF,       // Condition, block, then an else block or if, if any
+    NODE_WHILE,
     NODE_BLOCK,
+    NODE_FUNCTION, // Parameters, then the body
+    NODE_CALL,     // Arguments
+    NODE_RETURN,   // Value, if any
     NODE_UNKNOWN
 } NodeType;
 
@@ -44,266 +83,3096 @@ typedef enum
 typedef struct ASTNode
 {
     NodeType type;
-    char text[100];
-    struct ASTNode *children[3]; // Max 3 children
+    int returns;      // Function returns a value
+    const char *text; // Text of the token the node was made from
+    struct ASTNode **children; // Statements of a block, operands, condition and body
     int child_count;
+    int child_capacity;
 } ASTNode;
 
-// Global Variables
-Token tokens[100];
-int token_index = 0;
-int token_count = 0;
-int symbol_count = 0;
-int current_token_index = 0;
-Token current_token;
+// Statistics
+//
+// What -time-passes and -stats report. Each compilation counts into its
+// own copy, which is added to the totals when it is freed.
+typedef struct
+{
+    int compilations;
+    double lex_seconds;
+    double parse_seconds;
+    double generate_seconds;
+    long long tokens;
+    long long nodes;
+    long long bytes_allocated;
+    int parse_depth;    // Deepest nesting of blocks while parsing
+    int generate_depth; // Deepest recursion while generating code
+    int kind_count;
+    char kinds[MAX_KINDS][8]; // Instruction mnemonics, in order of first use
+    long long kind_counts[MAX_KINDS];
+    pthread_mutex_t lock; // Guards the totals
+} Stats;
+
+// Token Text
+//
+// Identifiers and numbers are copied out of the source into large blocks
+// that live as long as the compilation, so a token or node only holds a
+// pointer to its text. Keywords and operators point to string literals.
+typedef struct TextBlock
+{
+    struct TextBlock *next;
+    size_t used;
+    size_t size;
+    char text[];
+} TextBlock;
+
+// Compiler State
+//
+// Everything one compilation needs, so that several programs can be
+// compiled at the same time on different threads. Errors unwind to
+// compile() through 'on_error' with the message in 'error'.
+typedef struct
+{
+    Token *tokens;
+    int token_capacity;
+    int token_count;
+    int current_token_index;
+    TextBlock *text; // Newest block first
+    char symbols[MAX_SYMBOLS][2 * MAX_NAME]; // 'function.name' inside a function
+    int symbol_count;
+    ASTNode *functions[MAX_FUNCTIONS];
+    char function_state[MAX_FUNCTIONS]; // Call graph walk: 1 active, 2 checked
+    char function_used[MAX_FUNCTIONS];  // Reached from the program
+    int function_count;
+    int function; // Function being generated, -1 for the program
+    int int_bytes; // Width of int: 1, 2 or 4 bytes (-int 8, 16 or 32)
+    char temp_used[MAX_FUNCTIONS + 1]; // Scopes with a wide spill cell, the program first
+    int label_count;
+    int code_bytes; // Size of the code so far, as asm.py assembles it
+    int pushes;     // Values pushed and not popped yet
+    int max_pushes[MAX_FUNCTIONS + 1]; // Most at once in each scope, the program first
+    int call_pushes[MAX_FUNCTIONS + 1][MAX_FUNCTIONS]; // Same, plus the return address, at calls
+    int unlimited;  // Benchmarks: programs need not fit in memory
+    ASTNode **nodes; // Every node created, freed together
+    int node_count;
+    int node_capacity;
+    FILE *out;
+    char error[256];
+    jmp_buf on_error;
+    long long bytes_allocated;
+    int depth;
+    int max_depth;
+    Stats *stats; // Totals to add this compilation to, NULL when not counting
+    Stats counts;
+    int lex_threads; // Lex large inputs in chunks on this many threads
+} Compiler;
 
 // Function Prototypes
-void lexer(const char *input);
-Token getNextToken();
-ASTNode *parseProgram();
-ASTNode *parseStatement();
-ASTNode *parseExpression();
-void generateCode(ASTNode *node);
-void emit(const char *instruction);
-void testCompiler(const char *inputProgram);
+void lexer(Compiler *c, const char *input);
+int lexRange(Compiler *c, const char *input, size_t begin, size_t end, int line);
+Token getNextToken(Compiler *c);
+Token peekToken(Compiler *c);
+ASTNode *parseProgram(Compiler *c);
+ASTNode *parseBlock(Compiler *c);
+ASTNode *parseStatement(Compiler *c);
+ASTNode *parseCondition(Compiler *c);
+ASTNode *parseExpression(Compiler *c);
+ASTNode *parseFunction(Compiler *c, Token name, int returns);
+ASTNode *parseCall(Compiler *c, Token name);
+void generateCode(Compiler *c, ASTNode *node);
+void generateExpression(Compiler *c, ASTNode *node);
+void generateWideExpression(Compiler *c, ASTNode *node);
+void generateWideCall(Compiler *c, ASTNode *node);
+void generateWideBranch(Compiler *c, ASTNode *condition, const char *label, int when);
+void emit(Compiler *c, const char *format, ...);
+int findFunction(Compiler *c, const char *name);
+int compile(const char *input, FILE *out, Stats *stats, char *error, size_t error_size);
+void testCompiler(const char *inputProgram, Stats *stats);
+double now();
+
+// Count 'count' instructions of kind 'kind'
+void countKind(Stats *stats, const char *kind, long long count)
+{
+    int i = 0;
+    while (i < stats->kind_count && strcmp(stats->kinds[i], kind) != 0)
+        i++;
+    if (i == MAX_KINDS)
+        return;
+    if (i == stats->kind_count)
+    {
+        snprintf(stats->kinds[i], sizeof(stats->kinds[i]), "%s", kind);
+        stats->kind_count++;
+    }
+    stats->kind_counts[i] += count;
+}
+
+// Add the bytes asm.py assembles 'line' to, one for each word but the
+// registers, and follow the values on the stack of the current scope
+void measure(Compiler *c, const char *kind, const char *line)
+{
+    int scope = c->function + 1;
+    c->code_bytes++;
+    for (const char *p = strchr(line, ' '); p; p = strchr(p + 1, ' '))
+    {
+        if (!(strchr("ABCDEFGM", p[1]) && (p[2] == ' ' || p[2] == '\0')))
+            c->code_bytes++;
+    }
+    if (strcmp(kind, "push") == 0 && ++c->pushes > c->max_pushes[scope])
+    {
+        c->max_pushes[scope] = c->pushes;
+    }
+    else if (strcmp(kind, "pop") == 0)
+    {
+        c->pushes--;
+    }
+    else if (strcmp(kind, "call") == 0)
+    {
+        int f = findFunction(c, line + strlen("call %"));
+        if (c->call_pushes[scope][f] < c->pushes + 1)
+            c->call_pushes[scope][f] = c->pushes + 1;
+    }
+}
 
 // Emit assembly code
-void emit(const char *instruction)
+void emit(Compiler *c, const char *format, ...)
+{
+    char line[2 * MAX_NAME + 32], kind[8];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    sscanf(line, "%7s", kind);
+    if (c->stats)
+        countKind(&c->counts, kind, 1);
+    measure(c, kind, line);
+    fprintf(c->out, "    %s\n", line);
+}
+
+// Track how deep the parser or code generator has recursed
+void enterNesting(Compiler *c)
+{
+    if (++c->depth > c->max_depth)
+        c->max_depth = c->depth;
+}
+
+// Stop compiling with an error message
+void compileError(Compiler *c, const char *format, ...)
 {
-    printf("%s\n", instruction);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(c->error, sizeof(c->error), format, args);
+    va_end(args);
+    longjmp(c->on_error, 1);
+}
+
+// Report a syntax error and stop
+void syntaxError(Compiler *c, const char *expected, Token found)
+{
+    compileError(c, "Syntax error on line %d: expected %s but found '%s'", found.line, expected, found.text);
+}
+
+// Append a token, growing the token array as needed
+void addToken(Compiler *c, Token token)
+{
+    if (c->token_count == c->token_capacity)
+    {
+        c->bytes_allocated += (c->token_capacity ? c->token_capacity : 64) * sizeof(Token);
+        c->token_capacity = c->token_capacity ? c->token_capacity * 2 : 64;
+        c->tokens = realloc(c->tokens, c->token_capacity * sizeof(Token));
+    }
+    c->tokens[c->token_count++] = token;
+}
+
+// Copy 'length' bytes of the source into the text blocks, with a '\0'
+const char *copyText(Compiler *c, const char *start, size_t length)
+{
+    TextBlock *block = c->text;
+    if (!block || block->size - block->used < length + 1)
+    {
+        block = malloc(sizeof(TextBlock) + TEXT_BLOCK);
+        c->bytes_allocated += sizeof(TextBlock) + TEXT_BLOCK;
+        block->next = c->text;
+        block->used = 0;
+        block->size = TEXT_BLOCK;
+        c->text = block;
+    }
+    char *text = block->text + block->used;
+    memcpy(text, start, length);
+    text[length] = '\0';
+    block->used += length + 1;
+    return text;
 }
 
 // Lexer: Tokenize the input
-void lexer(const char *input)
+void lexer(Compiler *c, const char *input)
 {
-    int len = strlen(input);
-    int i = 0;
-    while (i < len)
+    int line = lexRange(c, input, 0, strlen(input), 1);
+    addToken(c, (Token){TOKEN_EOF, "EOF", line});
+}
+
+// Keywords, and the tokens they lex to
+static const struct
+{
+    const char *text;
+    TokenType type;
+} keywords[] = {
+    {"int", TOKEN_INT},
+    {"if", TOKEN_IF},
+    {"else", TOKEN_ELSE},
+    {"while", TOKEN_WHILE},
+    {"void", TOKEN_VOID},
+    {"return", TOKEN_RETURN},
+    {NULL, TOKEN_UNKNOWN},
+};
+
+// Tokenize input[begin, end), which starts on 'line'. Returns the line it
+// ends on.
+int lexRange(Compiler *c, const char *input, size_t begin, size_t end, int line)
+{
+    size_t i = begin;
+    while (i < end)
     {
-        char c = input[i];
-        if (isspace(c))
+        char ch = input[i];
+        if (isspace((unsigned char)ch))
         {
+            line += ch == '\n';
             i++;
             continue;
         }
-        Token token = {TOKEN_UNKNOWN, ""};
-        if (isalpha(c))
+        Token token = {TOKEN_UNKNOWN, "", line};
+        if (isalpha((unsigned char)ch))
         {
-            int start = i;
-            while (isalnum(input[i]))
+            size_t start = i;
+            while (i < end && isalnum((unsigned char)input[i]))
                 i++;
-            strncpy(token.text, input + start, i - start);
-            token.text[i - start] = '\0';
-            if (strcmp(token.text, "int") == 0)
-                token.type = TOKEN_INT;
-            else if (strcmp(token.text, "if") == 0)
-                token.type = TOKEN_IF;
-            else
+            size_t length = i - start;
+            if (length >= MAX_NAME)
+                compileError(c, "Identifier too long on line %d", line);
+            for (int k = 0; keywords[k].text; k++)
+            {
+                if (strlen(keywords[k].text) == length && memcmp(input + start, keywords[k].text, length) == 0)
+                {
+                    token.type = keywords[k].type;
+                    token.text = keywords[k].text;
+                }
+            }
+            if (token.type == TOKEN_UNKNOWN)
+            {
                 token.type = TOKEN_IDENTIFIER;
+                token.text = copyText(c, input + start, length);
+            }
         }
-        else if (isdigit(c))
+        else if (isdigit((unsigned char)ch))
         {
-            int start = i;
-            while (isdigit(input[i]))
+            size_t start = i;
+            while (i < end && isdigit((unsigned char)input[i]))
                 i++;
-            strncpy(token.text, input + start, i - start);
-            token.text[i - start] = '\0';
+            if (i - start >= MAX_NAME)
+                compileError(c, "Number too long on line %d", line);
+            token.text = copyText(c, input + start, i - start);
             token.type = TOKEN_NUMBER;
         }
+        else if ((ch == '=' || ch == '!' || ch == '<' || ch == '>') && i + 1 < end && input[i + 1] == '=')
+        {
+            token.type = ch == '=' ? TOKEN_EQUAL :
+                         ch == '!' ? TOKEN_NOT_EQUAL :
+                         ch == '<' ? TOKEN_LESS_EQUAL : TOKEN_GREATER_EQUAL;
+            token.text = ch == '=' ? "==" :
+                         ch == '!' ? "!=" :
+                         ch == '<' ? "<=" : ">=";
+            i += 2;
+        }
         else
         {
-            switch (c)
+            switch (ch)
             {
             case '=':
                 token.type = TOKEN_ASSIGN;
-                strcpy(token.text, "=");
+                token.text = "=";
+                break;
+            case '<':
+                token.type = TOKEN_LESS;
+                token.text = "<";
+                break;
+            case '>':
+                token.type = TOKEN_GREATER;
+                token.text = ">";
                 break;
             case '+':
                 token.type = TOKEN_PLUS;
-                strcpy(token.text, "+");
+                token.text = "+";
                 break;
             case '-':
                 token.type = TOKEN_MINUS;
-                strcpy(token.text, "-");
+                token.text = "-";
                 break;
             case '{':
                 token.type = TOKEN_LBRACE;
-                strcpy(token.text, "{");
+                token.text = "{";
                 break;
             case '}':
                 token.type = TOKEN_RBRACE;
-                strcpy(token.text, "}");
+                token.text = "}";
+                break;
+            case '(':
+                token.type = TOKEN_LPAREN;
+                token.text = "(";
+                break;
+            case ')':
+                token.type = TOKEN_RPAREN;
+                token.text = ")";
                 break;
             case ';':
                 token.type = TOKEN_SEMICOLON;
-                strcpy(token.text, ";");
+                token.text = ";";
+                break;
+            case ',':
+                token.type = TOKEN_COMMA;
+                token.text = ",";
                 break;
             default:
-                fprintf(stderr, "Unknown character: %c\n", c);
-                exit(1);
+                compileError(c, "Unknown character on line %d: %c", line, ch);
             }
             i++;
         }
-        tokens[token_count++] = token;
+        addToken(c, token);
     }
-    tokens[token_count++] = (Token){TOKEN_EOF, ""};
+    return line;
 }
 
 // Get the next token
-Token getNextToken()
+Token getNextToken(Compiler *c)
 {
-    if (current_token_index < token_count)
+    if (c->current_token_index < c->token_count)
     {
-        return tokens[current_token_index++];
+        return c->tokens[c->current_token_index++];
     }
-    return (Token){TOKEN_EOF, ""};
+    return (Token){TOKEN_EOF, "EOF", 0};
+}
+
+// Look at the next token without consuming it
+Token peekToken(Compiler *c)
+{
+    if (c->current_token_index < c->token_count)
+    {
+        return c->tokens[c->current_token_index];
+    }
+    return (Token){TOKEN_EOF, "EOF", 0};
+}
+
+// Consume a token of the given type or fail
+Token expectToken(Compiler *c, TokenType type, const char *expected)
+{
+    Token token = getNextToken(c);
+    if (token.type != type)
+    {
+        syntaxError(c, expected, token);
+    }
+    return token;
+}
+
+// AST Node Creation
+ASTNode *createNode(Compiler *c, NodeType type, const char *text)
+{
+    ASTNode *node = malloc(sizeof(ASTNode));
+    c->bytes_allocated += sizeof(ASTNode);
+    node->type = type;
+    node->returns = 0;
+    node->text = text ? text : "";
+    node->children = NULL;
+    node->child_count = 0;
+    node->child_capacity = 0;
+
+    if (c->node_count == c->node_capacity)
+    {
+        c->bytes_allocated += (c->node_capacity ? c->node_capacity : 64) * sizeof(ASTNode *);
+        c->node_capacity = c->node_capacity ? c->node_capacity * 2 : 64;
+        c->nodes = realloc(c->nodes, c->node_capacity * sizeof(ASTNode *));
+    }
+    c->nodes[c->node_count++] = node;
+    return node;
+}
+
+void addChild(ASTNode *parent, ASTNode *child)
+{
+    if (parent->child_count == parent->child_capacity)
+    {
+        parent->child_capacity = parent->child_capacity ? parent->child_capacity * 2 : 4;
+        parent->children = realloc(parent->children, parent->child_capacity * sizeof(ASTNode *));
+    }
+    parent->children[parent->child_count++] = child;
 }
 
 // Parser: Parse a program
-ASTNode *parseProgram()
+ASTNode *parseProgram(Compiler *c)
 {
-    ASTNode *program = malloc(sizeof(ASTNode));
-    program->type = NODE_PROGRAM;
-    program->child_count = 0;
-    while (current_token_index < token_count)
+    ASTNode *program = createNode(c, NODE_PROGRAM, NULL);
+    while (peekToken(c).type != TOKEN_EOF)
     {
-        ASTNode *stmt = parseStatement();
-        if (stmt)
-        {
-            program->children[program->child_count++] = stmt;
-        }
-        else
+        addChild(program, parseStatement(c));
+    }
+    return program;
+}
+
+// Parser: Parse '{' statements '}'
+ASTNode *parseBlock(Compiler *c)
+{
+    ASTNode *block = createNode(c, NODE_BLOCK, NULL);
+    enterNesting(c);
+    expectToken(c, TOKEN_LBRACE, "'{'");
+    while (peekToken(c).type != TOKEN_RBRACE)
+    {
+        if (peekToken(c).type == TOKEN_EOF)
         {
-            break;
+            syntaxError(c, "'}'", peekToken(c));
         }
+        addChild(block, parseStatement(c));
     }
-    return program;
+    getNextToken(c); // Consume '}'
+    c->depth--;
+    return block;
 }
 
 // Parser: Parse a statement
-ASTNode *parseStatement()
+ASTNode *parseStatement(Compiler *c)
 {
-    Token token = getNextToken();
+    Token token = getNextToken(c);
     if (token.type == TOKEN_INT)
     {
-        Token var = getNextToken();
-        if (var.type == TOKEN_IDENTIFIER)
-        {
-            Token semi = getNextToken();
-            if (semi.type == TOKEN_SEMICOLON)
-            {
-                ASTNode *node = malloc(sizeof(ASTNode));
-                node->type = NODE_VAR_DECL;
-                strcpy(node->text, var.text);
-                node->child_count = 0;
-                return node;
-            }
-        }
+        Token var = expectToken(c, TOKEN_IDENTIFIER, "identifier");
+        if (peekToken(c).type == TOKEN_LPAREN)
+            return parseFunction(c, var, 1);
+        expectToken(c, TOKEN_SEMICOLON, "';'");
+        return createNode(c, NODE_VAR_DECL, var.text);
+    }
+    else if (token.type == TOKEN_VOID)
+    {
+        return parseFunction(c, expectToken(c, TOKEN_IDENTIFIER, "identifier"), 0);
+    }
+    else if (token.type == TOKEN_RETURN)
+    {
+        ASTNode *node = createNode(c, NODE_RETURN, token.text);
+        if (peekToken(c).type != TOKEN_SEMICOLON)
+            addChild(node, parseExpression(c));
+        expectToken(c, TOKEN_SEMICOLON, "';'");
+        return node;
+    }
+    else if (token.type == TOKEN_IDENTIFIER && peekToken(c).type == TOKEN_LPAREN)
+    {
+        ASTNode *call = parseCall(c, token);
+        expectToken(c, TOKEN_SEMICOLON, "';'");
+        return call;
     }
     else if (token.type == TOKEN_IDENTIFIER)
     {
-        Token assign = getNextToken();
-        if (assign.type == TOKEN_ASSIGN)
-        {
-            ASTNode *expr = parseExpression();
-            Token semi = getNextToken();
-            if (semi.type == TOKEN_SEMICOLON)
-            {
-                ASTNode *node = malloc(sizeof(ASTNode));
-                node->type = NODE_ASSIGN;
-                strcpy(node->text, token.text);
-                node->children[0] = expr;
-                node->child_count = 1;
-                return node;
-            }
-        }
+        expectToken(c, TOKEN_ASSIGN, "'='");
+        ASTNode *node = createNode(c, NODE_ASSIGN, token.text);
+        addChild(node, parseExpression(c));
+        expectToken(c, TOKEN_SEMICOLON, "';'");
+        return node;
     }
-    else if (token.type == TOKEN_IF)
+    else if (token.type == TOKEN_IF || token.type == TOKEN_WHILE)
     {
-        Token lbrace = getNextToken();
-        if (lbrace.type == TOKEN_LBRACE)
+        ASTNode *node = createNode(c, token.type == TOKEN_IF ? NODE_IF : NODE_WHILE, token.text);
+        addChild(node, parseCondition(c));
+        addChild(node, parseBlock(c));
+        if (token.type == TOKEN_IF && peekToken(c).type == TOKEN_ELSE)
         {
-            ASTNode *block = parseProgram();
-            Token rbrace = getNextToken();
-            if (rbrace.type == TOKEN_RBRACE)
-            {
-                ASTNode *node = malloc(sizeof(ASTNode));
-                node->type = NODE_IF;
-                node->children[0] = block;
-                node->child_count = 1;
-                return node;
-            }
+            getNextToken(c); // Consume 'else'
+            addChild(node, peekToken(c).type == TOKEN_IF ? parseStatement(c) : parseBlock(c));
         }
+        return node;
     }
+    syntaxError(c, "statement", token);
     return NULL;
 }
 
-// Parser: Parse an expression
-ASTNode *parseExpression()
+// Parser: Parse '(' ['int' name {',' 'int' name}] ')' block, after the
+// function's name
+ASTNode *parseFunction(Compiler *c, Token name, int returns)
 {
-    Token token = getNextToken();
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = NODE_EXPRESSION;
-    strcpy(node->text, token.text);
-    node->child_count = 0;
+    if (c->depth > 0)
+    {
+        compileError(c, "Syntax error on line %d: function %s defined inside a block", name.line, name.text);
+    }
+    ASTNode *function = createNode(c, NODE_FUNCTION, name.text);
+    function->returns = returns;
+    expectToken(c, TOKEN_LPAREN, "'('");
+    while (peekToken(c).type != TOKEN_RPAREN)
+    {
+        if (function->child_count > 0)
+            expectToken(c, TOKEN_COMMA, "','");
+        expectToken(c, TOKEN_INT, "'int'");
+        addChild(function, createNode(c, NODE_VAR_DECL, expectToken(c, TOKEN_IDENTIFIER, "identifier").text));
+    }
+    getNextToken(c); // Consume ')'
+    addChild(function, parseBlock(c));
+    return function;
+}
+
+// Parser: Parse '(' [expression {',' expression}] ')', after the name
+ASTNode *parseCall(Compiler *c, Token name)
+{
+    ASTNode *call = createNode(c, NODE_CALL, name.text);
+    expectToken(c, TOKEN_LPAREN, "'('");
+    while (peekToken(c).type != TOKEN_RPAREN)
+    {
+        if (call->child_count > 0)
+            expectToken(c, TOKEN_COMMA, "','");
+        addChild(call, parseExpression(c));
+    }
+    getNextToken(c); // Consume ')'
+    return call;
+}
+
+// Parser: Parse '(' expression [comparison expression] ')'
+ASTNode *parseCondition(Compiler *c)
+{
+    expectToken(c, TOKEN_LPAREN, "'('");
+    ASTNode *condition = parseExpression(c);
+    TokenType type = peekToken(c).type;
+    if (type == TOKEN_EQUAL || type == TOKEN_NOT_EQUAL || type == TOKEN_LESS ||
+        type == TOKEN_GREATER || type == TOKEN_LESS_EQUAL || type == TOKEN_GREATER_EQUAL)
+    {
+        ASTNode *compare = createNode(c, NODE_BINARY, getNextToken(c).text);
+        addChild(compare, condition);
+        addChild(compare, parseExpression(c));
+        condition = compare;
+    }
+    expectToken(c, TOKEN_RPAREN, "')'");
+    return condition;
+}
+
+// Parser: Parse an operand or a call
+ASTNode *parseOperand(Compiler *c)
+{
+    Token token = getNextToken(c);
+    if (token.type != TOKEN_NUMBER && token.type != TOKEN_IDENTIFIER)
+    {
+        syntaxError(c, "number or identifier", token);
+    }
+    if (token.type == TOKEN_IDENTIFIER && peekToken(c).type == TOKEN_LPAREN)
+        return parseCall(c, token);
+    return createNode(c, NODE_EXPRESSION, token.text);
+}
+
+// Parser: Parse an expression, '+' and '-' are left associative
+ASTNode *parseExpression(Compiler *c)
+{
+    ASTNode *node = parseOperand(c);
+    while (peekToken(c).type == TOKEN_PLUS || peekToken(c).type == TOKEN_MINUS)
+    {
+        ASTNode *binary = createNode(c, NODE_BINARY, getNextToken(c).text);
+        addChild(binary, node);
+        addChild(binary, parseOperand(c));
+        node = binary;
+    }
     return node;
 }
 
-// Generate assembly code from the AST
-void generateCode(ASTNode *node)
+// Symbol table: every variable is one byte in the .data section. A
+// function's variables are named 'function.name', so it only sees its own.
+void symbolName(Compiler *c, const char *name, char *symbol)
 {
-    if (node == NULL)
+    if (c->function >= 0)
+        sprintf(symbol, "%s.%s", c->functions[c->function]->text, name);
+    else
+        strcpy(symbol, name);
+}
+
+// Byte i of a variable, x.1 for the second byte of x. The first is x.
+void byteName(const char *symbol, int i, char *name)
+{
+    if (i == 0)
+        strcpy(name, symbol);
+    else
+        sprintf(name, "%s.%d", symbol, i);
+}
+
+int findSymbol(Compiler *c, const char *name)
+{
+    char symbol[2 * MAX_NAME];
+    symbolName(c, name, symbol);
+    for (int i = 0; i < c->symbol_count; i++)
+    {
+        if (strcmp(c->symbols[i], symbol) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int findFunction(Compiler *c, const char *name)
+{
+    for (int i = 0; i < c->function_count; i++)
+    {
+        if (strcmp(c->functions[i]->text, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Add a variable of the current scope. Program variables are labels of
+// their own, so they cannot share a name with a function.
+int declareSymbol(Compiler *c, const char *name)
+{
+    if (findSymbol(c, name) >= 0 || c->symbol_count == MAX_SYMBOLS ||
+        (c->function < 0 && findFunction(c, name) >= 0))
+    {
+        compileError(c, "Cannot declare variable: %s", name);
+    }
+    symbolName(c, name, c->symbols[c->symbol_count]);
+    return c->symbol_count++;
+}
+
+// Index of a variable that must exist
+int useSymbol(Compiler *c, const char *name)
+{
+    int i = findSymbol(c, name);
+    if (i < 0)
+    {
+        compileError(c, "Undeclared variable: %s", name);
+    }
+    return i;
+}
+
+int isNumber(ASTNode *node)
+{
+    return node->type == NODE_EXPRESSION && isdigit((unsigned char)node->text[0]);
+}
+
+int isOperand(ASTNode *node)
+{
+    return node->type == NODE_EXPRESSION;
+}
+
+int hasCall(ASTNode *node)
+{
+    if (node->type == NODE_CALL)
+        return 1;
+    for (int i = 0; i < node->child_count; i++)
+    {
+        if (hasCall(node->children[i]))
+            return 1;
+    }
+    return 0;
+}
+
+// Load an operand into register A or B
+void generateOperand(Compiler *c, ASTNode *node, char reg)
+{
+    if (isNumber(node))
+    {
+        emit(c, "ldi %c %d", reg, atoi(node->text) & 0xFF);
         return;
+    }
+    const char *symbol = c->symbols[useSymbol(c, node->text)];
+    if (reg == 'A')
+        emit(c, "lda %%%s", symbol);
+    else
+        emit(c, "mov %c M %%%s", reg, symbol);
+}
 
-    switch (node->type)
+// Evaluate 'left' into A and 'right' into B. A nested right operand goes
+// first, through the stack, unless both sides make calls, which run left
+// to right.
+void generateOperands(Compiler *c, ASTNode *left, ASTNode *right)
+{
+    if (isOperand(right))
     {
-    case NODE_PROGRAM:
-        for (int i = 0; i < node->child_count; i++)
+        generateExpression(c, left);
+        generateOperand(c, right, 'B');
+    }
+    else if (hasCall(left))
+    {
+        generateExpression(c, left);
+        emit(c, "push A");
+        generateExpression(c, right);
+        emit(c, "mov B A");
+        emit(c, "pop A");
+    }
+    else
+    {
+        generateExpression(c, right);
+        emit(c, "push A");
+        generateExpression(c, left);
+        emit(c, "pop B");
+    }
+}
+
+// Call a function, leaving its result in A. The arguments go in B and up:
+// each one that needs A is evaluated first and pushed, except the last,
+// then the rest are loaded straight into their registers.
+void generateCall(Compiler *c, ASTNode *node)
+{
+    if (c->int_bytes > 1)
+    {
+        generateWideCall(c, node);
+        return;
+    }
+    if (strcmp(node->text, "out") == 0)
+    {
+        if (node->child_count != 1)
         {
-            generateCode(node->children[i]);
+            compileError(c, "Function out takes 1 argument");
         }
-        break;
+        generateExpression(c, node->children[0]);
+        emit(c, "out 0");
+        return;
+    }
 
-    case NODE_VAR_DECL:
-        printf("DECL %s\n", node->text);
-        break;
+    ASTNode *function = c->functions[findFunction(c, node->text)];
+    int params = function->child_count - 1;
+    if (node->child_count != params)
+    {
+        compileError(c, "Function %s takes %d argument%s", node->text, params, params == 1 ? "" : "s");
+    }
 
-    case NODE_ASSIGN:
-        printf("MOV %s, %s\n", node->text, node->children[0]->text);
-        break;
+    int last = -1;
+    for (int i = 0; i < params; i++)
+    {
+        if (!isOperand(node->children[i]))
+            last = i;
+    }
+    for (int i = 0; i <= last; i++)
+    {
+        if (isOperand(node->children[i]))
+            continue;
+        generateExpression(c, node->children[i]);
+        if (i == last)
+            emit(c, "mov %c A", 'B' + i);
+        else
+            emit(c, "push A");
+    }
+    for (int i = last - 1; i >= 0; i--)
+    {
+        if (!isOperand(node->children[i]))
+            emit(c, "pop %c", 'B' + i);
+    }
+    for (int i = 0; i < params; i++)
+    {
+        if (isOperand(node->children[i]))
+            generateOperand(c, node->children[i], 'B' + i);
+    }
+    emit(c, "call %%%s", node->text);
+}
 
-    case NODE_IF:
-        printf("IF_START\n");
-        generateCode(node->children[0]);
-        printf("IF_END\n");
-        break;
+// Evaluate an expression into register A, or C and up for a wide int
+void generateExpression(Compiler *c, ASTNode *node)
+{
+    if (c->int_bytes > 1)
+    {
+        generateWideExpression(c, node);
+        return;
+    }
+    if (isOperand(node))
+    {
+        generateOperand(c, node, 'A');
+        return;
+    }
+    enterNesting(c);
+    if (node->type == NODE_CALL)
+    {
+        if (strcmp(node->text, "out") == 0 || !c->functions[findFunction(c, node->text)]->returns)
+        {
+            compileError(c, "Function %s does not return a value", node->text);
+        }
+        generateCall(c, node);
+        c->depth--;
+        return;
+    }
 
-    case NODE_EXPRESSION:
-        // Here you would generate code for expressions
-        printf("MOV R0, %s\n", node->text);
-        break;
+    generateOperands(c, node->children[0], node->children[1]);
 
-    default:
-        printf("Unknown AST Node Type\n");
-        break;
-    }
+    if (strcmp(node->text, "+") == 0)
+        emit(c, "add");
+    else if (strcmp(node->text, "-") == 0)
+        emit(c, "sub");
+    c->depth--;
 }
 
-// Test the compiler
-void testCompiler(const char *inputProgram)
+// Jump to 'label' when the condition is 'when'. cmp sets zero for A == B
+// and carry for A < B, so '>' and '<=' swap their operands.
+void generateBranch(Compiler *c, ASTNode *condition, const char *label, int when)
 {
-    lexer(inputProgram);
-    ASTNode *ast = parseProgram();
-    printf("Generated Assembly Code:\n");
-    generateCode(ast);
+    const char *op = condition->text;
+    const char *jump;
+
+    if (c->int_bytes > 1)
+    {
+        generateWideBranch(c, condition, label, when);
+        return;
+    }
+    if (condition->type != NODE_BINARY || strcmp(op, "+") == 0 || strcmp(op, "-") == 0)
+    {
+        generateExpression(c, condition);
+        emit(c, "ldi B 0");
+        emit(c, "cmp");
+        emit(c, "%s %%%s", when ? "jnz" : "jz", label);
+        return;
+    }
+
+    ASTNode *left = condition->children[0];
+    ASTNode *right = condition->children[1];
+    if (strcmp(op, ">") == 0 || strcmp(op, "<=") == 0)
+    {
+        left = condition->children[1];
+        right = condition->children[0];
+        op = strcmp(op, ">") == 0 ? "<" : ">=";
+    }
+
+    generateOperands(c, left, right);
+
+    if (strcmp(op, "==") == 0)
+        jump = when ? "je" : "jne";
+    else if (strcmp(op, "!=") == 0)
+        jump = when ? "jne" : "je";
+    else if (strcmp(op, "<") == 0)
+        jump = when ? "jc" : "jnc";
+    else
+        jump = when ? "jnc" : "jc";
+
+    emit(c, "cmp");
+    emit(c, "%s %%%s", jump, label);
 }
 
-int main()
+// Wide Ints
+//
+// With -int 16 or -int 32 a value is two or four bytes, low byte first,
+// and a variable x takes the cells x, x.1, ... An expression leaves its
+// value in registers C and up, C and D for a 16-bit int. Each byte of an
+// operation goes through A and B and back to its register in C and up,
+// taking the other operand from where it is: a variable or number, the
+// bytes of a nested operand pushed high byte first, or the scope's spill
+// cell _t for a comparison, which cannot leave half its bytes on the stack.
+
+typedef enum
 {
-    const char *inputProgram =
-        "int a;\n"
-        "a = 10;\n"
-        "if { a = 20; }\n";
-    testCompiler(inputProgram);
+    BYTES_REGISTERS, // C and up
+    BYTES_STACK,     // Popped low byte first
+    BYTES_TEMP,      // Spill cell of the scope
+    BYTES_OPERAND    // A variable or number
+} ByteSource;
+
+// Put byte i of a value in 'reg'
+void loadByte(Compiler *c, char reg, ByteSource from, ASTNode *operand, int i)
+{
+    char symbol[2 * MAX_NAME], name[2 * MAX_NAME + 16];
+
+    if (from == BYTES_REGISTERS)
+    {
+        if (reg != 'C' + i)
+            emit(c, "mov %c %c", reg, 'C' + i);
+        return;
+    }
+    if (from == BYTES_STACK)
+    {
+        emit(c, "pop %c", reg);
+        return;
+    }
+    if (from == BYTES_OPERAND && isNumber(operand))
+    {
+        emit(c, "ldi %c %lu", reg, (strtoul(operand->text, NULL, 10) >> (8 * i)) & 0xFF);
+        return;
+    }
+    if (from == BYTES_TEMP)
+        symbolName(c, "_t", symbol);
+    else
+        strcpy(symbol, c->symbols[useSymbol(c, operand->text)]);
+    byteName(symbol, i, name);
+    if (reg == 'A')
+        emit(c, "lda %%%s", name);
+    else
+        emit(c, "mov %c M %%%s", reg, name);
+}
+
+// Push the value in C and up, high byte first
+void pushWide(Compiler *c)
+{
+    for (int i = c->int_bytes - 1; i >= 0; i--)
+        emit(c, "push %c", 'C' + i);
+}
+
+// Store the value in C and up to the scope's spill cell
+void spillWide(Compiler *c)
+{
+    char symbol[2 * MAX_NAME], name[2 * MAX_NAME + 16];
+    symbolName(c, "_t", symbol);
+    c->temp_used[c->function + 1] = 1;
+    for (int i = 0; i < c->int_bytes; i++)
+    {
+        byteName(symbol, i, name);
+        emit(c, "mov M %c %%%s", 'C' + i, name);
+    }
+}
+
+// add, then adc for every byte above the first, which takes the carry
+void generateWideAdd(Compiler *c, ByteSource a, ByteSource b, ASTNode *operand)
+{
+    for (int i = 0; i < c->int_bytes; i++)
+    {
+        loadByte(c, 'A', a, NULL, i);
+        loadByte(c, 'B', b, operand, i);
+        emit(c, i == 0 ? "add" : "adc");
+        emit(c, "mov %c A", 'C' + i);
+    }
+}
+
+// There is no subtract with borrow. sub leaves the borrow in carry, so the
+// top byte takes it off with dec first. A byte in between adds it into the
+// subtrahend with adc, where it may overflow: then a.i - 256 is a.i and
+// the borrow is out again.
+void generateWideSub(Compiler *c, ByteSource a, ByteSource b, ASTNode *operand)
+{
+    for (int i = 0; i < c->int_bytes; i++)
+    {
+        int id = c->label_count++;
+        if (i == 0)
+        {
+            loadByte(c, 'A', a, NULL, i);
+            loadByte(c, 'B', b, operand, i);
+            emit(c, "sub");
+        }
+        else if (i == c->int_bytes - 1)
+        {
+            loadByte(c, 'A', a, NULL, i);
+            loadByte(c, 'B', b, operand, i);
+            emit(c, "jnc %%_w%d", id);
+            emit(c, "dec");
+            fprintf(c->out, "_w%d:\n", id);
+            emit(c, "sub");
+        }
+        else
+        {
+            loadByte(c, 'A', b, operand, i);
+            emit(c, "ldi B 0");
+            emit(c, "adc");
+            emit(c, "jc %%_w%d_overflow", id);
+            emit(c, "mov B A");
+            loadByte(c, 'A', a, NULL, i);
+            emit(c, "sub");
+            emit(c, "jmp %%_w%d", id);
+            fprintf(c->out, "_w%d_overflow:\n", id);
+            loadByte(c, 'A', a, NULL, i);
+            fprintf(c->out, "_w%d:\n", id);
+        }
+        emit(c, "mov %c A", 'C' + i);
+    }
+}
+
+// Evaluate an expression into C and up. A nested right operand goes first,
+// through the stack, unless the left one makes calls, as with 8 bits.
+void generateWideExpression(Compiler *c, ASTNode *node)
+{
+    if (isOperand(node))
+    {
+        for (int i = 0; i < c->int_bytes; i++)
+            loadByte(c, 'C' + i, BYTES_OPERAND, node, i);
+        return;
+    }
+    enterNesting(c);
+    if (node->type == NODE_CALL)
+    {
+        if (strcmp(node->text, "out") == 0 || !c->functions[findFunction(c, node->text)]->returns)
+        {
+            compileError(c, "Function %s does not return a value", node->text);
+        }
+        generateWideCall(c, node);
+        c->depth--;
+        return;
+    }
+
+    ASTNode *left = node->children[0];
+    ASTNode *right = node->children[1];
+    ByteSource a = BYTES_REGISTERS, b = BYTES_REGISTERS;
+    if (isOperand(right))
+    {
+        generateWideExpression(c, left);
+        b = BYTES_OPERAND;
+    }
+    else if (hasCall(left))
+    {
+        generateWideExpression(c, left);
+        pushWide(c);
+        generateWideExpression(c, right);
+        a = BYTES_STACK;
+    }
+    else
+    {
+        generateWideExpression(c, right);
+        pushWide(c);
+        generateWideExpression(c, left);
+        b = BYTES_STACK;
+    }
+
+    if (strcmp(node->text, "+") == 0)
+        generateWideAdd(c, a, b, right);
+    else if (strcmp(node->text, "-") == 0)
+        generateWideSub(c, a, b, right);
+    c->depth--;
+}
+
+// Call a function with wide arguments, in consecutive registers from B:
+// B and C for the first 16-bit one. The result comes back in C and up.
+void generateWideCall(Compiler *c, ASTNode *node)
+{
+    int bytes = c->int_bytes;
+
+    if (strcmp(node->text, "out") == 0)
+    {
+        if (node->child_count != 1)
+        {
+            compileError(c, "Function out takes 1 argument");
+        }
+        ASTNode *value = node->children[0];
+        ByteSource from = isOperand(value) ? BYTES_OPERAND : BYTES_REGISTERS;
+        if (from == BYTES_REGISTERS)
+            generateWideExpression(c, value);
+        for (int i = bytes - 1; i >= 0; i--)
+        {
+            loadByte(c, 'A', from, value, i);
+            emit(c, "out 0");
+        }
+        return;
+    }
+
+    ASTNode *function = c->functions[findFunction(c, node->text)];
+    int params = function->child_count - 1;
+    if (node->child_count != params)
+    {
+        compileError(c, "Function %s takes %d argument%s", node->text, params, params == 1 ? "" : "s");
+    }
+
+    // The last argument that needs C and up moves straight to its
+    // registers, in the order that reads each byte before it is replaced
+    int last = -1;
+    for (int i = 0; i < params; i++)
+    {
+        if (!isOperand(node->children[i]))
+            last = i;
+    }
+    for (int i = 0; i <= last; i++)
+    {
+        if (isOperand(node->children[i]))
+            continue;
+        generateWideExpression(c, node->children[i]);
+        if (i < last)
+        {
+            pushWide(c);
+            continue;
+        }
+        for (int k = 0; k < bytes; k++)
+        {
+            int b = i == 0 ? k : bytes - 1 - k;
+            emit(c, "mov %c %c", 'B' + i * bytes + b, 'C' + b);
+        }
+    }
+    for (int i = last - 1; i >= 0; i--)
+    {
+        for (int b = 0; b < bytes && !isOperand(node->children[i]); b++)
+            emit(c, "pop %c", 'B' + i * bytes + b);
+    }
+    for (int i = 0; i < params; i++)
+    {
+        for (int b = 0; b < bytes && isOperand(node->children[i]); b++)
+            loadByte(c, 'B' + i * bytes + b, BYTES_OPERAND, node->children[i], b);
+    }
+    emit(c, "call %%%s", node->text);
+}
+
+// Compare from the high byte down, leaving as soon as a byte decides. Only
+// the low byte's cmp decides like an 8-bit one.
+void generateWideBranch(Compiler *c, ASTNode *condition, const char *label, int when)
+{
+    const char *op = condition->text;
+    int id = c->label_count++;
+    char skip[32];
+
+    if (condition->type != NODE_BINARY || strcmp(op, "+") == 0 || strcmp(op, "-") == 0)
+    {
+        // Nonzero when any byte is
+        generateWideExpression(c, condition);
+        emit(c, "mov A C");
+        for (int i = 1; i < c->int_bytes; i++)
+        {
+            emit(c, "mov B %c", 'C' + i);
+            emit(c, "or");
+        }
+        emit(c, "%s %%%s", when ? "jnz" : "jz", label);
+        return;
+    }
+
+    ASTNode *left = condition->children[0];
+    ASTNode *right = condition->children[1];
+    if (strcmp(op, ">") == 0 || strcmp(op, "<=") == 0)
+    {
+        left = condition->children[1];
+        right = condition->children[0];
+        op = strcmp(op, ">") == 0 ? "<" : ">=";
+    }
+
+    ByteSource a = BYTES_REGISTERS, b = BYTES_OPERAND;
+    if (!isOperand(right) && hasCall(left))
+    {
+        generateWideExpression(c, left);
+        spillWide(c);
+        generateWideExpression(c, right);
+        a = BYTES_TEMP;
+        b = BYTES_REGISTERS;
+    }
+    else if (!isOperand(right))
+    {
+        generateWideExpression(c, right);
+        spillWide(c);
+        generateWideExpression(c, left);
+        b = BYTES_TEMP;
+    }
+    else
+    {
+        generateWideExpression(c, left);
+    }
+
+    // Where a byte that decides goes when the condition holds, or not
+    sprintf(skip, "_w%d", id);
+    const char *taken = when ? label : skip;
+    const char *other = when ? skip : label;
+    for (int i = c->int_bytes - 1; i > 0; i--)
+    {
+        loadByte(c, 'A', a, NULL, i);
+        loadByte(c, 'B', b, right, i);
+        emit(c, "cmp");
+        if (strcmp(op, "==") == 0)
+        {
+            emit(c, "jne %%%s", other);
+        }
+        else if (strcmp(op, "!=") == 0)
+        {
+            emit(c, "jne %%%s", taken);
+        }
+        else if (strcmp(op, "<") == 0)
+        {
+            emit(c, "jc %%%s", taken);
+            emit(c, "jne %%%s", other);
+        }
+        else
+        {
+            emit(c, "jc %%%s", other);
+            emit(c, "jne %%%s", taken);
+        }
+    }
+
+    const char *jump;
+    if (strcmp(op, "==") == 0)
+        jump = when ? "je" : "jne";
+    else if (strcmp(op, "!=") == 0)
+        jump = when ? "jne" : "je";
+    else if (strcmp(op, "<") == 0)
+        jump = when ? "jc" : "jnc";
+    else
+        jump = when ? "jnc" : "jc";
+    loadByte(c, 'A', a, NULL, 0);
+    loadByte(c, 'B', b, right, 0);
+    emit(c, "cmp");
+    emit(c, "%s %%%s", jump, label);
+    fprintf(c->out, "%s:\n", skip);
+}
+
+// Check every call under 'node' and the functions it reaches. Functions
+// keep their variables in .data, so a call back into one that is already
+// active is an error.
+void checkCalls(Compiler *c, ASTNode *node)
+{
+    if (node->type == NODE_CALL && strcmp(node->text, "out") != 0)
+    {
+        int f = findFunction(c, node->text);
+        if (f < 0)
+        {
+            compileError(c, "Undeclared function: %s", node->text);
+        }
+        if (c->function_state[f] == 1)
+        {
+            compileError(c, "Recursive call to %s", node->text);
+        }
+        if (c->function_state[f] == 0)
+        {
+            c->function_state[f] = 1;
+            checkCalls(c, c->functions[f]);
+            c->function_state[f] = 2;
+        }
+    }
+    for (int i = 0; i < node->child_count; i++)
+    {
+        if (node->children[i]->type != NODE_FUNCTION)
+            checkCalls(c, node->children[i]);
+    }
+}
+
+// Mark the functions that the calls under 'node' reach
+void markUsed(Compiler *c, ASTNode *node)
+{
+    if (node->type == NODE_CALL && strcmp(node->text, "out") != 0)
+    {
+        int f = findFunction(c, node->text);
+        if (!c->function_used[f])
+        {
+            c->function_used[f] = 1;
+            markUsed(c, c->functions[f]);
+        }
+    }
+    for (int i = 0; i < node->child_count; i++)
+    {
+        if (node->children[i]->type != NODE_FUNCTION)
+            markUsed(c, node->children[i]);
+    }
+}
+
+// Declare the locals of a function, wherever they are in its body
+void declareLocals(Compiler *c, ASTNode *node)
+{
+    for (int i = 0; i < node->child_count; i++)
+    {
+        if (node->children[i]->type == NODE_VAR_DECL)
+            declareSymbol(c, node->children[i]->text);
+        else
+            declareLocals(c, node->children[i]);
+    }
+}
+
+// A called function takes its arguments in B and up and returns its result
+// in A, or in C and up for a wide int. Its locals start at 0 on every call.
+void generateFunction(Compiler *c, int f)
+{
+    ASTNode *function = c->functions[f];
+    ASTNode *body = function->children[function->child_count - 1];
+    char name[2 * MAX_NAME + 16];
+    c->function = f;
+    fprintf(c->out, "%s:\n", function->text);
+    for (int i = 0; i < function->child_count - 1; i++)
+    {
+        int symbol = declareSymbol(c, function->children[i]->text);
+        for (int b = 0; b < c->int_bytes; b++)
+        {
+            byteName(c->symbols[symbol], b, name);
+            emit(c, "mov M %c %%%s", 'B' + i * c->int_bytes + b, name);
+        }
+    }
+    int first_local = c->symbol_count;
+    declareLocals(c, body);
+    if (c->symbol_count > first_local)
+        emit(c, "ldi A 0");
+    for (int i = first_local; i < c->symbol_count; i++)
+    {
+        for (int b = 0; b < c->int_bytes; b++)
+        {
+            byteName(c->symbols[i], b, name);
+            emit(c, "sta %%%s", name);
+        }
+    }
+    generateCode(c, body);
+    if (body->child_count == 0 || body->children[body->child_count - 1]->type != NODE_RETURN)
+    {
+        if (function->returns && c->int_bytes == 1)
+        {
+            emit(c, "ldi A 0");
+        }
+        else if (function->returns)
+        {
+            for (int b = 0; b < c->int_bytes; b++)
+                emit(c, "ldi %c 0", 'C' + b);
+        }
+        emit(c, "ret");
+    }
+    c->function = -1;
+}
+
+// Most bytes 'scope' has on the stack, its calls included. The program is
+// scope 0, function f is f + 1.
+int stackBytes(Compiler *c, int scope)
+{
+    int bytes = c->max_pushes[scope];
+    for (int f = 0; f < c->function_count; f++)
+    {
+        if (c->call_pushes[scope][f] && c->call_pushes[scope][f] + stackBytes(c, f + 1) > bytes)
+            bytes = c->call_pushes[scope][f] + stackBytes(c, f + 1);
+    }
+    return bytes;
+}
+
+// asm.py places .data right after the code, one byte per entry, and the
+// stack grows down from 0xff into the same 256 bytes
+void checkMemory(Compiler *c)
+{
+    int data = c->symbol_count * c->int_bytes;
+    for (int f = 0; f <= c->function_count; f++)
+    {
+        if (c->temp_used[f])
+            data += c->int_bytes;
+    }
+    int stack = stackBytes(c, 0);
+    if (!c->unlimited && c->code_bytes + data + stack > 256)
+    {
+        compileError(c, "Memory error: %d bytes of code, %d of data and %d of stack do not fit in 256",
+                     c->code_bytes, data, stack);
+    }
+}
+
+// Generate assembly code from the AST
+void generateCode(Compiler *c, ASTNode *node)
+{
+    char label[32];
+    char name[2 * MAX_NAME + 16];
+
+    if (node == NULL)
+        return;
+    enterNesting(c);
+
+    switch (node->type)
+    {
+    case NODE_PROGRAM:
+        c->function = -1;
+        for (int i = 0; i < node->child_count; i++)
+        {
+            ASTNode *function = node->children[i];
+            if (function->type != NODE_FUNCTION)
+                continue;
+            if (strcmp(function->text, "out") == 0 || findFunction(c, function->text) >= 0 ||
+                c->function_count == MAX_FUNCTIONS)
+            {
+                compileError(c, "Cannot define function: %s", function->text);
+            }
+            if ((function->child_count - 1) * c->int_bytes > MAX_PARAMS)
+            {
+                compileError(c, "Function %s has more than %d parameters", function->text,
+                             MAX_PARAMS / c->int_bytes);
+            }
+            c->functions[c->function_count++] = function;
+        }
+        for (int f = 0; f < c->function_count; f++)
+        {
+            checkCalls(c, c->functions[f]);
+        }
+        checkCalls(c, node);
+        markUsed(c, node);
+
+        fprintf(c->out, ".text\n");
+        for (int i = 0; i < node->child_count; i++)
+        {
+            if (node->children[i]->type != NODE_FUNCTION)
+                generateCode(c, node->children[i]);
+        }
+        // Print every variable on the output port before halting, the
+        // high byte first
+        for (int i = 0; i < c->symbol_count; i++)
+        {
+            for (int b = c->int_bytes - 1; b >= 0; b--)
+            {
+                byteName(c->symbols[i], b, name);
+                emit(c, "lda %%%s", name);
+                emit(c, "out 0");
+            }
+        }
+        emit(c, "hlt");
+        for (int f = 0; f < c->function_count; f++)
+        {
+            if (c->function_used[f])
+                generateFunction(c, f);
+        }
+        checkMemory(c);
+        fprintf(c->out, "\n.data\n");
+        for (int i = 0; i < c->symbol_count; i++)
+        {
+            for (int b = 0; b < c->int_bytes; b++)
+            {
+                byteName(c->symbols[i], b, name);
+                fprintf(c->out, "%s = 0\n", name);
+            }
+        }
+        for (int f = -1; f < c->function_count; f++)
+        {
+            char temp[2 * MAX_NAME];
+            if (!c->temp_used[f + 1])
+                continue;
+            c->function = f;
+            symbolName(c, "_t", temp);
+            for (int b = 0; b < c->int_bytes; b++)
+            {
+                byteName(temp, b, name);
+                fprintf(c->out, "%s = 0\n", name);
+            }
+        }
+        c->function = -1;
+        break;
+
+    case NODE_BLOCK:
+        for (int i = 0; i < node->child_count; i++)
+        {
+            generateCode(c, node->children[i]);
+        }
+        break;
+
+    case NODE_VAR_DECL:
+        // A function's locals are declared on entry
+        if (c->function < 0)
+            declareSymbol(c, node->text);
+        break;
+
+    case NODE_ASSIGN:
+    {
+        int symbol = useSymbol(c, node->text);
+        generateExpression(c, node->children[0]);
+        if (c->int_bytes == 1)
+        {
+            emit(c, "sta %%%s", c->symbols[symbol]);
+            break;
+        }
+        for (int b = 0; b < c->int_bytes; b++)
+        {
+            byteName(c->symbols[symbol], b, name);
+            emit(c, "mov M %c %%%s", 'C' + b, name);
+        }
+        break;
+    }
+
+    case NODE_CALL:
+        generateCall(c, node);
+        break;
+
+    case NODE_RETURN:
+        if (c->function < 0)
+        {
+            compileError(c, "Return outside a function");
+        }
+        if (node->child_count != c->functions[c->function]->returns)
+        {
+            compileError(c, "Function %s %s", c->functions[c->function]->text,
+                         node->child_count ? "does not return a value" : "must return a value");
+        }
+        if (node->child_count)
+            generateExpression(c, node->children[0]);
+        emit(c, "ret");
+        break;
+
+    case NODE_IF:
+    {
+        int id = c->label_count++;
+        sprintf(label, node->child_count == 3 ? "_if%d_else" : "_if%d_end", id);
+        generateBranch(c, node->children[0], label, 0);
+        generateCode(c, node->children[1]);
+        if (node->child_count == 3)
+        {
+            // A block that ends in return has no need to jump over the else
+            ASTNode *then = node->children[1];
+            if (then->child_count == 0 || then->children[then->child_count - 1]->type != NODE_RETURN)
+                emit(c, "jmp %%_if%d_end", id);
+            fprintf(c->out, "%s:\n", label);
+            generateCode(c, node->children[2]);
+            fprintf(c->out, "_if%d_end:\n", id);
+        }
+        else
+        {
+            fprintf(c->out, "%s:\n", label);
+        }
+        break;
+    }
+
+    case NODE_WHILE:
+    {
+        // Rotated loop: jump to the test once, then one branch per iteration.
+        // Unlike assemblycode there is no IR here, so no hoisting or unrolling
+        int id = c->label_count++;
+        sprintf(label, "_while%d_cond", id);
+        emit(c, "jmp %%%s", label);
+        fprintf(c->out, "_while%d:\n", id);
+        generateCode(c, node->children[1]);
+        fprintf(c->out, "%s:\n", label);
+        sprintf(label, "_while%d", id);
+        generateBranch(c, node->children[0], label, 1);
+        break;
+    }
+
+    case NODE_EXPRESSION:
+    case NODE_BINARY:
+        generateExpression(c, node);
+        break;
+
+    default:
+        fprintf(c->out, "Unknown AST Node Type\n");
+        break;
+    }
+    c->depth--;
+}
+
+Compiler *newCompiler(FILE *out)
+{
+    Compiler *c = calloc(1, sizeof(Compiler));
+    c->out = out;
+    c->int_bytes = 1;
+    return c;
+}
+
+// Add the counts of one compilation to the totals
+void addStats(Stats *total, Stats *counts)
+{
+    pthread_mutex_lock(&total->lock);
+    total->compilations++;
+    total->lex_seconds += counts->lex_seconds;
+    total->parse_seconds += counts->parse_seconds;
+    total->generate_seconds += counts->generate_seconds;
+    total->tokens += counts->tokens;
+    total->nodes += counts->nodes;
+    total->bytes_allocated += counts->bytes_allocated;
+    if (counts->parse_depth > total->parse_depth)
+        total->parse_depth = counts->parse_depth;
+    if (counts->generate_depth > total->generate_depth)
+        total->generate_depth = counts->generate_depth;
+    for (int i = 0; i < counts->kind_count; i++)
+    {
+        countKind(total, counts->kinds[i], counts->kind_counts[i]);
+    }
+    pthread_mutex_unlock(&total->lock);
+}
+
+// Print the totals, the stage times for -time-passes and the counts for
+// -stats, as text or as one JSON object
+void printStats(FILE *out, Stats *stats, int time_passes, int counts, int json)
+{
+    double total = stats->lex_seconds + stats->parse_seconds + stats->generate_seconds;
+    long long instructions = 0;
+    for (int i = 0; i < stats->kind_count; i++)
+    {
+        instructions += stats->kind_counts[i];
+    }
+
+    if (json)
+    {
+        fprintf(out, "{\"compilations\": %d", stats->compilations);
+        if (time_passes)
+            fprintf(out, ", \"lex_seconds\": %.6f, \"parse_seconds\": %.6f, \"generate_seconds\": %.6f, "
+                    "\"total_seconds\": %.6f", stats->lex_seconds, stats->parse_seconds,
+                    stats->generate_seconds, total);
+        if (counts)
+        {
+            fprintf(out, ", \"tokens\": %lld, \"nodes\": %lld, \"bytes_allocated\": %lld, "
+                    "\"parse_depth\": %d, \"generate_depth\": %d, \"instructions\": %lld, \"kinds\": {",
+                    stats->tokens, stats->nodes, stats->bytes_allocated, stats->parse_depth,
+                    stats->generate_depth, instructions);
+            for (int i = 0; i < stats->kind_count; i++)
+            {
+                fprintf(out, "%s\"%s\": %lld", i ? ", " : "", stats->kinds[i], stats->kind_counts[i]);
+            }
+            fprintf(out, "}");
+        }
+        fprintf(out, "}\n");
+        return;
+    }
+
+    if (time_passes)
+    {
+        const char *names[] = {"lex", "parse", "generate"};
+        double seconds[] = {stats->lex_seconds, stats->parse_seconds, stats->generate_seconds};
+        fprintf(out, "Pass times (%d compilations):\n", stats->compilations);
+        for (int i = 0; i < 3; i++)
+        {
+            fprintf(out, "  %-10s %10.6f s %6.1f%%\n", names[i], seconds[i], total > 0 ? 100 * seconds[i] / total : 0);
+        }
+        fprintf(out, "  %-10s %10.6f s\n", "total", total);
+    }
+    if (counts)
+    {
+        fprintf(out, "Statistics (%d compilations):\n", stats->compilations);
+        fprintf(out, "  %-20s %12lld\n", "tokens", stats->tokens);
+        fprintf(out, "  %-20s %12lld\n", "AST nodes", stats->nodes);
+        fprintf(out, "  %-20s %12lld\n", "bytes allocated", stats->bytes_allocated);
+        fprintf(out, "  %-20s %12d\n", "max parse depth", stats->parse_depth);
+        fprintf(out, "  %-20s %12d\n", "max generate depth", stats->generate_depth);
+        fprintf(out, "  %-20s %12lld\n", "instructions", instructions);
+        for (int i = 0; i < stats->kind_count; i++)
+        {
+            fprintf(out, "    %-18s %12lld\n", stats->kinds[i], stats->kind_counts[i]);
+        }
+    }
+}
+
+// Release everything a compilation allocated
+void freeCompiler(Compiler *c)
+{
+    for (int i = 0; i < c->node_count; i++)
+    {
+        c->bytes_allocated += c->nodes[i]->child_capacity * sizeof(ASTNode *);
+        free(c->nodes[i]->children);
+        free(c->nodes[i]);
+    }
+    if (c->stats)
+    {
+        c->counts.tokens = c->token_count;
+        c->counts.nodes = c->node_count;
+        c->counts.bytes_allocated = c->bytes_allocated;
+        addStats(c->stats, &c->counts);
+    }
+    while (c->text)
+    {
+        TextBlock *next = c->text->next;
+        free(c->text);
+        c->text = next;
+    }
+    free(c->nodes);
+    free(c->tokens);
+    free(c);
+}
+
+// Parallel Lexing
+//
+// A large input is cut into chunks right after a ';' or '}', which always
+// end a token, and the chunks are lexed on their own threads. First each
+// thread counts the lines in its chunk so that every chunk knows the line
+// it starts on, then each lexes its chunk into its own token array, then
+// the arrays are copied side by side into one stream. The tokens, line
+// numbers and first error are the same as lexing the input in one go.
+
+typedef struct
+{
+    const char *input;
+    size_t begin;
+    size_t end;
+    int line;     // Line the chunk starts on
+    int newlines; // Lines the chunk ends
+    Compiler *c;  // Tokens and error of the chunk
+    int failed;
+    Token *tokens; // Where the chunk's tokens go in the stream
+} LexChunk;
+
+void *countChunkLines(void *arg)
+{
+    LexChunk *chunk = arg;
+    const char *p = chunk->input + chunk->begin;
+    const char *end = chunk->input + chunk->end;
+    while ((p = memchr(p, '\n', end - p)) != NULL)
+    {
+        chunk->newlines++;
+        p++;
+    }
+    return NULL;
+}
+
+void *lexChunk(void *arg)
+{
+    LexChunk *chunk = arg;
+    if (setjmp(chunk->c->on_error) != 0)
+    {
+        chunk->failed = 1;
+        return NULL;
+    }
+    lexRange(chunk->c, chunk->input, chunk->begin, chunk->end, chunk->line);
+    return NULL;
+}
+
+void *copyChunk(void *arg)
+{
+    LexChunk *chunk = arg;
+    memcpy(chunk->tokens, chunk->c->tokens, chunk->c->token_count * sizeof(Token));
+    return NULL;
+}
+
+// Run 'step' on every chunk, each on its own thread
+void runChunks(LexChunk *chunks, int count, void *(*step)(void *))
+{
+    pthread_t threads[MAX_THREADS];
+    for (int i = 1; i < count; i++)
+    {
+        pthread_create(&threads[i], NULL, step, &chunks[i]);
+    }
+    step(&chunks[0]);
+    for (int i = 1; i < count; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// Tokenize 'input' on up to 'threads' threads. Stops with the first error
+// in the input, like lexer().
+void lexParallel(Compiler *c, const char *input, size_t size, int threads)
+{
+    LexChunk chunks[MAX_THREADS];
+    int count = 0;
+    size_t begin = 0;
+
+    // Cut after the first ';' or '}' past each even share of the input
+    while (begin < size && count < threads)
+    {
+        size_t end = count == threads - 1 ? size : begin + (size - begin) / (threads - count);
+        if (end == begin)
+            end++;
+        while (end < size && input[end - 1] != ';' && input[end - 1] != '}')
+            end++;
+        memset(&chunks[count], 0, sizeof(LexChunk));
+        chunks[count].input = input;
+        chunks[count].begin = begin;
+        chunks[count].end = end;
+        chunks[count].c = newCompiler(NULL);
+        count++;
+        begin = end;
+    }
+
+    runChunks(chunks, count, countChunkLines);
+    int line = 1;
+    for (int i = 0; i < count; i++)
+    {
+        chunks[i].line = line;
+        line += chunks[i].newlines;
+    }
+    runChunks(chunks, count, lexChunk);
+
+    int total = 0;
+    for (int i = 0; i < count && !c->error[0]; i++)
+    {
+        if (chunks[i].failed)
+            snprintf(c->error, sizeof(c->error), "%s", chunks[i].c->error);
+        total += chunks[i].c->token_count;
+    }
+    if (!c->error[0])
+    {
+        c->token_capacity = total + 1;
+        c->tokens = malloc(c->token_capacity * sizeof(Token));
+        c->bytes_allocated += c->token_capacity * sizeof(Token);
+        for (int i = 0, offset = 0; i < count; i++)
+        {
+            chunks[i].tokens = c->tokens + offset;
+            offset += chunks[i].c->token_count;
+        }
+        runChunks(chunks, count, copyChunk);
+        c->token_count = total;
+        addToken(c, (Token){TOKEN_EOF, "EOF", line});
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        // The tokens point into the chunk's text, which 'c' now owns
+        if (!c->error[0])
+        {
+            TextBlock **last = &chunks[i].c->text;
+            while (*last)
+                last = &(*last)->next;
+            *last = c->text;
+            c->text = chunks[i].c->text;
+            chunks[i].c->text = NULL;
+        }
+        freeCompiler(chunks[i].c);
+    }
+    if (c->error[0])
+        longjmp(c->on_error, 1);
+}
+
+// Tokenize 'input', in chunks on c->lex_threads threads if it is large.
+// Returns 1 with the message in c->error on failure.
+int lexSource(Compiler *c, const char *input)
+{
+    if (setjmp(c->on_error) != 0)
+        return 1;
+    double start = c->stats ? now() : 0;
+    size_t size = strlen(input);
+    int threads = c->lex_threads;
+    if ((size_t)threads > size / LEX_CHUNK_MIN)
+        threads = (int)(size / LEX_CHUNK_MIN);
+    if (threads > 1)
+        lexParallel(c, input, size, threads);
+    else
+        lexer(c, input);
+    if (c->stats)
+        c->counts.lex_seconds += now() - start;
+    return 0;
+}
+
+// Parse the tokens into '*ast'. Returns 1 with the message in c->error on
+// failure.
+int parseSource(Compiler *c, ASTNode **ast)
+{
+    if (setjmp(c->on_error) != 0)
+        return 1;
+    double start = c->stats ? now() : 0;
+    c->max_depth = 0;
+    *ast = parseProgram(c);
+    if (c->stats)
+    {
+        c->counts.parse_seconds += now() - start;
+        c->counts.parse_depth = c->max_depth;
+    }
+    return 0;
+}
+
+// Write the assembly for 'ast' to c->out. Returns 1 with the message in
+// c->error on failure.
+int generateAssembly(Compiler *c, ASTNode *ast)
+{
+    if (setjmp(c->on_error) != 0)
+        return 1;
+    double start = c->stats ? now() : 0;
+    c->max_depth = 0;
+    generateCode(c, ast);
+    if (c->stats)
+    {
+        c->counts.generate_seconds += now() - start;
+        c->counts.generate_depth = c->max_depth;
+    }
+    return 0;
+}
+
+// Parse the tokens and write the assembly to c->out
+int generateProgram(Compiler *c)
+{
+    ASTNode *ast = NULL;
+    return parseSource(c, &ast) || generateAssembly(c, ast);
+}
+
+// Compile 'input' to 'out', counting into 'stats' unless it is NULL.
+// Returns 0 on success, or 1 with the message in 'error'. Safe to call
+// from several threads at once.
+int compile(const char *input, FILE *out, Stats *stats, char *error, size_t error_size)
+{
+    Compiler *c = newCompiler(out);
+    c->stats = stats;
+    int failed = lexSource(c, input) || generateProgram(c);
+    if (failed)
+        snprintf(error, error_size, "%s", c->error);
+    freeCompiler(c);
+    return failed;
+}
+
+// Test the compiler
+void testCompiler(const char *inputProgram, Stats *stats)
+{
+    char error[256];
+    printf("Generated Assembly Code:\n");
+    if (compile(inputProgram, stdout, stats, error, sizeof(error)))
+    {
+        fprintf(stderr, "%s\n", error);
+        exit(1);
+    }
+}
+
+// SHA-256, for naming cache entries after their contents
+
+typedef struct
+{
+    unsigned int state[8];
+    unsigned char block[64];
+    unsigned long long length;
+    size_t used;
+} Sha256;
+
+static const unsigned int sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+void sha256Init(Sha256 *h)
+{
+    static const unsigned int initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(h->state, initial, sizeof(initial));
+    h->length = 0;
+    h->used = 0;
+}
+
+void sha256Block(Sha256 *h)
+{
+    unsigned int w[64], s[8];
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (unsigned int)h->block[i * 4] << 24 | h->block[i * 4 + 1] << 16 |
+               h->block[i * 4 + 2] << 8 | h->block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        unsigned int s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        unsigned int s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(s, h->state, sizeof(s));
+    for (int i = 0; i < 64; i++)
+    {
+        unsigned int t1 = s[7] + (ROTR(s[4], 6) ^ ROTR(s[4], 11) ^ ROTR(s[4], 25)) +
+                          ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256_k[i] + w[i];
+        unsigned int t2 = (ROTR(s[0], 2) ^ ROTR(s[0], 13) ^ ROTR(s[0], 22)) +
+                          ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(s + 1, s, 7 * sizeof(unsigned int));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++)
+        h->state[i] += s[i];
+}
+
+void sha256Update(Sha256 *h, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    h->length += size;
+    while (size > 0)
+    {
+        size_t chunk = 64 - h->used < size ? 64 - h->used : size;
+        memcpy(h->block + h->used, bytes, chunk);
+        h->used += chunk;
+        bytes += chunk;
+        size -= chunk;
+        if (h->used == 64)
+        {
+            sha256Block(h);
+            h->used = 0;
+        }
+    }
+}
+
+// Finish the hash and write it as 64 hex digits
+void sha256Hex(Sha256 *h, char hex[65])
+{
+    unsigned long long bits = h->length * 8;
+    unsigned char pad = 0x80, length[8];
+    sha256Update(h, &pad, 1);
+    pad = 0;
+    while (h->used != 56)
+        sha256Update(h, &pad, 1);
+    for (int i = 0; i < 8; i++)
+        length[i] = (unsigned char)(bits >> (56 - i * 8));
+    sha256Update(h, length, 8);
+    for (int i = 0; i < 8; i++)
+        sprintf(hex + i * 8, "%08x", h->state[i]);
+}
+
+// Compilation Cache
+//
+// Outputs are stored under the SHA-256 of the program's token stream,
+// together with the compiler version and the options that affect them, so
+// edits to whitespace do not cause a recompile. A second, smaller entry
+// maps the hash of the raw source to that key, which lets an unchanged
+// file be answered without lexing it at all.
+//
+//   <dir>/<key>.obj  "asm <size>\n" assembly "list <size>\n" memory image
+//   <dir>/<key>.src  the .obj key for a source hash
+//
+// Entries are written to a temporary file and renamed into place, so a
+// reader never sees half an entry. A hit touches the entry, and as soon as
+// a store takes the directory over its size limit, entries are evicted
+// least recently used first.
+
+typedef struct
+{
+    const char *dir;     // NULL when caching is off
+    long long max_bytes;
+    char options[4200];  // Everything besides the program the output depends on
+    pthread_mutex_t lock;
+    int source_hits;     // Found from the raw source
+    int token_hits;      // Found after lexing
+    int misses;
+    int evicted;
+    long long bytes;     // Size at the last eviction, plus what was stored since
+    int evicting;        // A thread is evicting
+    unsigned temp_count;
+} Cache;
+
+// A compiled program: the assembly, and the memory image when asked for
+typedef struct
+{
+    char *assembly;
+    size_t assembly_size;
+    char *image;
+    size_t image_size;
+} Output;
+
+void freeOutput(Output *output)
+{
+    free(output->assembly);
+    free(output->image);
+}
+
+// Write 'size' bytes to 'path' through a temporary file and a rename
+int writeFileAtomic(Cache *cache, const char *path, const char *data, size_t size)
+{
+    char temp[4200];
+    pthread_mutex_lock(&cache->lock);
+    unsigned count = cache->temp_count++;
+    pthread_mutex_unlock(&cache->lock);
+
+    snprintf(temp, sizeof(temp), "%s.tmp.%ld.%u", path, (long)getpid(), count);
+    FILE *file = fopen(temp, "wb");
+    if (!file)
+        return 0;
+    int ok = fwrite(data, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temp, path) != 0)
+    {
+        remove(temp);
+        return 0;
+    }
+    return 1;
+}
+
+void cachePath(Cache *cache, const char *key, const char *extension, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%s.%s", cache->dir, key, extension);
+}
+
+void sourceKey(Cache *cache, const char *input, char key[65])
+{
+    Sha256 h;
+    sha256Init(&h);
+    sha256Update(&h, "source", 7);
+    sha256Update(&h, cache->options, strlen(cache->options) + 1);
+    sha256Update(&h, input, strlen(input));
+    sha256Hex(&h, key);
+}
+
+// Key of the lexed program: only token types and spellings count
+void tokenKey(Cache *cache, Compiler *c, char key[65])
+{
+    Sha256 h;
+    sha256Init(&h);
+    sha256Update(&h, "tokens", 7);
+    sha256Update(&h, cache->options, strlen(cache->options) + 1);
+    for (int i = 0; i < c->token_count; i++)
+    {
+        unsigned char type = (unsigned char)c->tokens[i].type;
+        sha256Update(&h, &type, 1);
+        sha256Update(&h, c->tokens[i].text, strlen(c->tokens[i].text) + 1);
+    }
+    sha256Hex(&h, key);
+}
+
+// Read the whole of 'path'. Returns NULL if it cannot be read.
+char *readEntry(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *data = malloc(length + 1);
+    *size = fread(data, 1, length, file);
+    data[*size] = '\0';
+    fclose(file);
+    return data;
+}
+
+// Parse a "<name> <size>\n" header at 'data'. Returns its length, or 0 if
+// there is none.
+size_t parseHeader(const char *data, const char *name, size_t *size)
+{
+    size_t length = strlen(name);
+    char *end;
+    if (strncmp(data, name, length) != 0 || data[length] != ' ' || !isdigit((unsigned char)data[length + 1]))
+        return 0;
+    errno = 0;
+    unsigned long value = strtoul(data + length + 1, &end, 10);
+    if (errno != 0 || *end != '\n')
+        return 0;
+    *size = value;
+    return end + 1 - data;
+}
+
+// Load the object stored under 'key'. A hit marks it as recently used.
+int cacheLoad(Cache *cache, const char *key, Output *output)
+{
+    char path[4200];
+    size_t size, assembly_size, image_size;
+
+    cachePath(cache, key, "obj", path, sizeof(path));
+    char *data = readEntry(path, &size);
+    if (!data)
+        return 0;
+
+    memset(output, 0, sizeof(*output));
+    size_t header = parseHeader(data, "asm", &assembly_size);
+    if (header > 0 && assembly_size <= size - header)
+    {
+        char *image = data + header + assembly_size;
+        size_t rest = size - header - assembly_size;
+        size_t image_header = parseHeader(image, "list", &image_size);
+        output->assembly = malloc(assembly_size + 1);
+        memcpy(output->assembly, data + header, assembly_size);
+        output->assembly[assembly_size] = '\0';
+        output->assembly_size = assembly_size;
+        if (image_header > 0 && image_size == rest - image_header)
+        {
+            if (image_size > 0)
+            {
+                output->image = malloc(image_size + 1);
+                memcpy(output->image, image + image_header, image_size);
+                output->image[image_size] = '\0';
+                output->image_size = image_size;
+            }
+            free(data);
+            utime(path, NULL);
+            return 1;
+        }
+    }
+    free(data);
+    freeOutput(output);
+    return 0;
+}
+
+// Object key recorded for a source hash
+int cacheLoadSource(Cache *cache, const char *source, char key[65])
+{
+    char path[4200];
+    size_t size;
+    cachePath(cache, source, "src", path, sizeof(path));
+    char *data = readEntry(path, &size);
+    if (!data)
+        return 0;
+    int ok = size == 64 && strspn(data, "0123456789abcdef") == 64;
+    if (ok)
+    {
+        memcpy(key, data, 65);
+        utime(path, NULL);
+    }
+    free(data);
+    return ok;
+}
+
+void cacheEvict(Cache *cache);
+
+// Count 'size' more bytes in the cache, and evict if that takes it over
+// the limit, unless another thread is already at it
+void cacheGrow(Cache *cache, size_t size)
+{
+    pthread_mutex_lock(&cache->lock);
+    cache->bytes += size;
+    int evict = cache->bytes > cache->max_bytes && !cache->evicting;
+    if (evict)
+        cache->evicting = 1;
+    pthread_mutex_unlock(&cache->lock);
+    if (evict)
+    {
+        cacheEvict(cache);
+        pthread_mutex_lock(&cache->lock);
+        cache->evicting = 0;
+        pthread_mutex_unlock(&cache->lock);
+    }
+}
+
+void cacheStore(Cache *cache, const char *key, Output *output)
+{
+    char path[4200], header[64];
+    cachePath(cache, key, "obj", path, sizeof(path));
+
+    int assembly_header = sprintf(header, "asm %zu\n", output->assembly_size);
+    size_t size = assembly_header + output->assembly_size + 32 + output->image_size;
+    char *data = malloc(size);
+    memcpy(data, header, assembly_header);
+    memcpy(data + assembly_header, output->assembly, output->assembly_size);
+    size_t used = assembly_header + output->assembly_size;
+    used += sprintf(data + used, "list %zu\n", output->image_size);
+    if (output->image_size > 0)
+        memcpy(data + used, output->image, output->image_size);
+    used += output->image_size;
+
+    if (writeFileAtomic(cache, path, data, used))
+        cacheGrow(cache, used);
+    free(data);
+}
+
+void cacheStoreSource(Cache *cache, const char *source, const char *key)
+{
+    char path[4200];
+    cachePath(cache, source, "src", path, sizeof(path));
+    if (writeFileAtomic(cache, path, key, 64))
+        cacheGrow(cache, 64);
+}
+
+void countLookup(Cache *cache, int *counter)
+{
+    pthread_mutex_lock(&cache->lock);
+    (*counter)++;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+typedef struct
+{
+    char name[512];
+    char key[65]; // Of the .obj, or of the .obj a .src points to
+    long long size;
+    struct timespec used;
+} CacheEntry;
+
+// An .obj and the .src entries that point to it
+typedef struct
+{
+    int first;
+    int count;
+    struct timespec used; // Latest of its entries
+} CacheGroup;
+
+int compareTimes(const struct timespec *x, const struct timespec *y)
+{
+    if (x->tv_sec != y->tv_sec)
+        return x->tv_sec < y->tv_sec ? -1 : 1;
+    return x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec;
+}
+
+int compareKeys(const void *a, const void *b)
+{
+    return strcmp(((const CacheEntry *)a)->key, ((const CacheEntry *)b)->key);
+}
+
+int compareGroups(const void *a, const void *b)
+{
+    return compareTimes(&((const CacheGroup *)a)->used, &((const CacheGroup *)b)->used);
+}
+
+// Remove least recently used entries until the cache fits its limit. An
+// .obj goes together with the .src entries that point to it, so no .src
+// is left naming an object that is gone.
+void cacheEvict(Cache *cache)
+{
+    CacheEntry *entries = NULL;
+    int count = 0, capacity = 0, evicted = 0;
+    long long total = 0;
+    char path[4200];
+    struct dirent *file;
+
+    DIR *dir = opendir(cache->dir);
+    if (!dir)
+        return;
+    while ((file = readdir(dir)) != NULL)
+    {
+        const char *extension = strrchr(file->d_name, '.');
+        struct stat info;
+        if (!extension || (strcmp(extension, ".obj") != 0 && strcmp(extension, ".src") != 0))
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", cache->dir, file->d_name);
+        if (stat(path, &info) != 0 || strlen(file->d_name) >= sizeof(entries->name))
+            continue;
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            entries = realloc(entries, capacity * sizeof(CacheEntry));
+        }
+        CacheEntry *entry = &entries[count];
+        strcpy(entry->name, file->d_name);
+        snprintf(entry->key, sizeof(entry->key), "%.*s", (int)(extension - file->d_name), file->d_name);
+        // Read without cacheLoadSource, which would touch it. A .src that
+        // does not hold a key goes on its own.
+        if (strcmp(extension, ".src") == 0)
+        {
+            size_t size;
+            char *key = readEntry(path, &size);
+            if (key && size == 64 && strspn(key, "0123456789abcdef") == 64)
+                memcpy(entry->key, key, 65);
+            else
+                snprintf(entry->key, sizeof(entry->key), "%s", file->d_name);
+            free(key);
+        }
+        entry->size = info.st_size;
+        entry->used = info.st_mtim;
+        total += info.st_size;
+        count++;
+    }
+    closedir(dir);
+
+    if (count > 0)
+        qsort(entries, count, sizeof(CacheEntry), compareKeys);
+    CacheGroup *groups = malloc((count + 1) * sizeof(CacheGroup));
+    int group_count = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (i == 0 || strcmp(entries[i].key, entries[i - 1].key) != 0)
+        {
+            groups[group_count].first = i;
+            groups[group_count].count = 0;
+            groups[group_count].used = entries[i].used;
+            group_count++;
+        }
+        CacheGroup *group = &groups[group_count - 1];
+        group->count++;
+        if (compareTimes(&entries[i].used, &group->used) > 0)
+            group->used = entries[i].used;
+    }
+
+    if (group_count > 0)
+        qsort(groups, group_count, sizeof(CacheGroup), compareGroups);
+    for (int g = 0; g < group_count && total > cache->max_bytes; g++)
+    {
+        for (int i = groups[g].first; i < groups[g].first + groups[g].count; i++)
+        {
+            snprintf(path, sizeof(path), "%s/%s", cache->dir, entries[i].name);
+            if (remove(path) == 0)
+            {
+                total -= entries[i].size;
+                evicted++;
+            }
+        }
+    }
+    pthread_mutex_lock(&cache->lock);
+    cache->bytes = total;
+    cache->evicted += evicted;
+    pthread_mutex_unlock(&cache->lock);
+    free(groups);
+    free(entries);
+}
+
+// Batch Compilation
+//
+// Every input file is compiled to a file next to it with the extension
+// replaced by .asm, and .list for the memory image when an assembler is
+// given. Files are shared out on a work-stealing thread pool:
+// each worker starts with a contiguous run of files and takes from the
+// back of its own queue, and when that is empty it steals from the front
+// of another worker's queue.
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    int head; // Next file a thief takes
+    int tail; // One past the next file the owner takes
+} WorkQueue;
+
+typedef struct
+{
+    const char **files;
+    int file_count;
+    int thread_count;
+    Cache *cache;
+    const char *assembler; // asm.py command, NULL for no memory images
+    Stats *stats;          // NULL when not counting
+    int lex_threads;
+    int int_bytes;
+    WorkQueue queues[MAX_THREADS];
+    int failed;
+    pthread_mutex_t report_lock;
+} Batch;
+
+typedef struct
+{
+    Batch *batch;
+    int id;
+} Worker;
+
+char *readFile(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    size_t read = fread(text, 1, size, file);
+    text[read] = '\0';
+    fclose(file);
+    return text;
+}
+
+// Output path for 'path': its extension replaced by 'extension'
+void outputPath(const char *path, const char *extension, char *out, size_t size)
+{
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    int length = dot && (!slash || dot > slash) ? (int)(dot - path) : (int)strlen(path);
+    snprintf(out, size, "%.*s%s", length, path, extension);
+}
+
+void reportFailure(Batch *batch, const char *path, const char *message)
+{
+    pthread_mutex_lock(&batch->report_lock);
+    fprintf(stderr, "%s: %s\n", path, message);
+    batch->failed++;
+    pthread_mutex_unlock(&batch->report_lock);
+}
+
+// Run the assembler on 'asm_path' and keep what it prints as the image
+int assemble(Batch *batch, const char *asm_path, Output *output)
+{
+    char command[8400], *quoted = command;
+    quoted += sprintf(quoted, "%s '", batch->assembler);
+    for (const char *p = asm_path; *p && quoted < command + sizeof(command) - 8; p++)
+    {
+        if (*p == '\'')
+            quoted += sprintf(quoted, "'\\''");
+        else
+            *quoted++ = *p;
+    }
+    strcpy(quoted, "'");
+
+    FILE *pipe = popen(command, "r");
+    if (!pipe)
+        return 0;
+    FILE *image = open_memstream(&output->image, &output->image_size);
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+        fwrite(buffer, 1, read, image);
+    fclose(image);
+    return pclose(pipe) == 0;
+}
+
+// Write one output of 'path' next to it, with the given extension
+int writeOutput(Batch *batch, const char *path, const char *extension, const char *data, size_t size)
+{
+    char out[4096];
+    outputPath(path, extension, out, sizeof(out));
+    if (!writeFileAtomic(batch->cache, out, data, size))
+    {
+        reportFailure(batch, out, "cannot write file");
+        return 0;
+    }
+    return 1;
+}
+
+// Write the outputs of 'path' found in the cache
+void writeCached(Batch *batch, const char *path, Output *output)
+{
+    if (writeOutput(batch, path, ".asm", output->assembly, output->assembly_size) && batch->assembler)
+        writeOutput(batch, path, ".list", output->image, output->image_size);
+}
+
+// Compile one file, going through the cache when there is one
+void compileFile(Batch *batch, const char *path)
+{
+    Cache *cache = batch->cache;
+    Output output = {NULL, 0, NULL, 0};
+    char source[65], key[65], asm_path[4096];
+    char *input = readFile(path);
+    if (!input)
+    {
+        reportFailure(batch, path, "cannot read file");
+        return;
+    }
+
+    if (cache->dir)
+    {
+        sourceKey(cache, input, source);
+        if (cacheLoadSource(cache, source, key) && cacheLoad(cache, key, &output))
+        {
+            countLookup(cache, &cache->source_hits);
+            writeCached(batch, path, &output);
+            freeOutput(&output);
+            free(input);
+            return;
+        }
+    }
+
+    Compiler *c = newCompiler(NULL);
+    c->stats = batch->stats;
+    c->lex_threads = batch->lex_threads;
+    c->int_bytes = batch->int_bytes;
+    if (lexSource(c, input))
+    {
+        reportFailure(batch, path, c->error);
+        freeCompiler(c);
+        free(input);
+        return;
+    }
+    free(input);
+
+    if (cache->dir)
+    {
+        tokenKey(cache, c, key);
+        if (cacheLoad(cache, key, &output))
+        {
+            countLookup(cache, &cache->token_hits);
+            cacheStoreSource(cache, source, key);
+            writeCached(batch, path, &output);
+            freeOutput(&output);
+            freeCompiler(c);
+            return;
+        }
+        countLookup(cache, &cache->misses);
+    }
+
+    c->out = open_memstream(&output.assembly, &output.assembly_size);
+    int failed = generateProgram(c);
+    fclose(c->out);
+    if (failed)
+    {
+        reportFailure(batch, path, c->error);
+        freeOutput(&output);
+        freeCompiler(c);
+        return;
+    }
+    freeCompiler(c);
+
+    // The assembler reads the .asm file, so it is written before the image
+    outputPath(path, ".asm", asm_path, sizeof(asm_path));
+    int ok = writeOutput(batch, path, ".asm", output.assembly, output.assembly_size);
+    if (ok && batch->assembler)
+    {
+        ok = assemble(batch, asm_path, &output);
+        if (!ok)
+            reportFailure(batch, asm_path, "assembler failed");
+        else
+            ok = writeOutput(batch, path, ".list", output.image, output.image_size);
+    }
+    if (ok && cache->dir)
+    {
+        cacheStore(cache, key, &output);
+        cacheStoreSource(cache, source, key);
+    }
+    freeOutput(&output);
+}
+
+// Next file for worker 'id', from its own queue or stolen. -1 when all
+// queues are empty.
+int takeFile(Batch *batch, int id)
+{
+    for (int i = 0; i < batch->thread_count; i++)
+    {
+        int victim = (id + i) % batch->thread_count;
+        WorkQueue *queue = &batch->queues[victim];
+        int file = -1;
+
+        pthread_mutex_lock(&queue->lock);
+        if (queue->head < queue->tail)
+        {
+            file = victim == id ? --queue->tail : queue->head++;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        if (file >= 0)
+            return file;
+    }
+    return -1;
+}
+
+void *runWorker(void *arg)
+{
+    Worker *worker = arg;
+    int file;
+    while ((file = takeFile(worker->batch, worker->id)) >= 0)
+    {
+        compileFile(worker->batch, worker->batch->files[file]);
+    }
+    return NULL;
+}
+
+// Compile every file on 'thread_count' threads, returning the number of
+// files that failed
+int compileBatch(const char **files, int file_count, int thread_count, Cache *cache, const char *assembler,
+                 Stats *stats, int lex_threads, int int_bytes)
+{
+    Batch *batch = calloc(1, sizeof(Batch));
+    pthread_t threads[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+
+    batch->files = files;
+    batch->file_count = file_count;
+    batch->thread_count = thread_count;
+    batch->cache = cache;
+    batch->assembler = assembler;
+    batch->stats = stats;
+    batch->lex_threads = lex_threads;
+    batch->int_bytes = int_bytes;
+    pthread_mutex_init(&batch->report_lock, NULL);
+    for (int i = 0; i < thread_count; i++)
+    {
+        pthread_mutex_init(&batch->queues[i].lock, NULL);
+        batch->queues[i].head = (int)((long long)file_count * i / thread_count);
+        batch->queues[i].tail = (int)((long long)file_count * (i + 1) / thread_count);
+    }
+
+    for (int i = 0; i < thread_count; i++)
+    {
+        workers[i].batch = batch;
+        workers[i].id = i;
+        pthread_create(&threads[i], NULL, runWorker, &workers[i]);
+    }
+    for (int i = 0; i < thread_count; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    int failed = batch->failed;
+    for (int i = 0; i < thread_count; i++)
+    {
+        pthread_mutex_destroy(&batch->queues[i].lock);
+    }
+    pthread_mutex_destroy(&batch->report_lock);
+    free(batch);
+    return failed;
+}
+
+double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Synthetic Programs
+//
+// Deterministic SimpleLang sources for measuring how each stage scales.
+// The same shape, size and seed always give the same program.
+//   flat    short assignments
+//   nested  if chains BENCH_NESTING deep, an assignment at every level
+//   expr    assignments with 16 to 64 operands
+//   ident   short assignments over 64 variables with 40 to 90 letter names
+
+const char *bench_shapes[] = {"flat", "nested", "expr", "ident", NULL};
+
+unsigned int nextRandom(unsigned long long *state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned int)(*state >> 33);
+}
+
+int isBenchShape(const char *shape)
+{
+    for (int i = 0; bench_shapes[i]; i++)
+    {
+        if (strcmp(bench_shapes[i], shape) == 0)
+            return 1;
+    }
     return 0;
 }
+
+// Write 'name = operand +/- operand ...;' with 'operands' operands
+void writeAssignment(FILE *out, char names[][100], int name_count, int operands, int indent,
+                     unsigned long long *state)
+{
+    fprintf(out, "%*s%s =", indent, "", names[nextRandom(state) % name_count]);
+    for (int i = 0; i < operands; i++)
+    {
+        if (i > 0)
+            fprintf(out, " %c", nextRandom(state) % 2 ? '+' : '-');
+        if (nextRandom(state) % 4 == 0)
+            fprintf(out, " %u", nextRandom(state) % 256);
+        else
+            fprintf(out, " %s", names[nextRandom(state) % name_count]);
+    }
+    fprintf(out, ";\n");
+}
+
+// Write a program of 'shape' with 'statements' statements, not counting
+// the declarations
+void writeSynthetic(FILE *out, const char *shape, long statements, unsigned long long seed)
+{
+    static const char *compares[] = {"==", "!=", "<", ">", "<=", ">="};
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    char names[MAX_SYMBOLS][100];
+    unsigned long long state = seed;
+    int ident = strcmp(shape, "ident") == 0;
+    int name_count = ident ? MAX_SYMBOLS : 16;
+    int depth = 0;
+
+    for (int i = 0; i < name_count; i++)
+    {
+        int length = sprintf(names[i], "v%d", i);
+        if (ident)
+        {
+            int target = 40 + nextRandom(&state) % 51;
+            while (length < target)
+                names[i][length++] = letters[nextRandom(&state) % (sizeof(letters) - 1)];
+            names[i][length] = '\0';
+        }
+        fprintf(out, "int %s;\n", names[i]);
+    }
+
+    for (long written = 0; written < statements; written++)
+    {
+        if (strcmp(shape, "nested") == 0 && written % 2 == 1)
+        {
+            // Every other statement opens the next level, until the chain
+            // is deep enough to be closed and started again
+            if (depth == BENCH_NESTING)
+            {
+                while (depth > 0)
+                    fprintf(out, "%*s}\n", 2 * --depth, "");
+            }
+            fprintf(out, "%*sif (%s %s %u) {\n", 2 * depth, "", names[nextRandom(&state) % name_count],
+                    compares[nextRandom(&state) % 6], nextRandom(&state) % 256);
+            depth++;
+        }
+        else if (strcmp(shape, "expr") == 0)
+        {
+            writeAssignment(out, names, name_count, 16 + nextRandom(&state) % 49, 0, &state);
+        }
+        else
+        {
+            writeAssignment(out, names, name_count, 1 + nextRandom(&state) % 3, 2 * depth, &state);
+        }
+    }
+    while (depth > 0)
+        fprintf(out, "%*s}\n", 2 * --depth, "");
+}
+
+// Compile a generated program with each stage timed on its own, and print
+// the result as one line of JSON. The assembly goes to /dev/null.
+int benchmark(const char *shape, long statements, unsigned long long seed, int lex_threads)
+{
+    char *source = NULL;
+    size_t size = 0;
+    FILE *generated = open_memstream(&source, &size);
+    writeSynthetic(generated, shape, statements, seed);
+    fclose(generated);
+
+    FILE *sink = fopen("/dev/null", "w");
+    Compiler *c = newCompiler(sink);
+    c->lex_threads = lex_threads;
+    c->unlimited = 1;
+    ASTNode *ast = NULL;
+    double lex_seconds = 0, parse_seconds = 0, generate_seconds = 0;
+
+    double start = now();
+    int failed = lexSource(c, source);
+    lex_seconds = now() - start;
+    if (!failed)
+    {
+        start = now();
+        failed = parseSource(c, &ast);
+        parse_seconds = now() - start;
+    }
+    if (!failed)
+    {
+        start = now();
+        failed = generateAssembly(c, ast);
+        fflush(sink);
+        generate_seconds = now() - start;
+    }
+    if (failed)
+    {
+        fprintf(stderr, "%s %ld: %s\n", shape, statements, c->error);
+    }
+    else
+    {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        double total = lex_seconds + parse_seconds + generate_seconds;
+        printf("{\"shape\": \"%s\", \"statements\": %ld, \"seed\": %llu, \"bytes\": %zu, \"tokens\": %d, "
+               "\"nodes\": %d, \"lex_seconds\": %.6f, \"parse_seconds\": %.6f, \"generate_seconds\": %.6f, "
+               "\"tokens_per_second\": %.0f, \"nodes_per_second\": %.0f, \"bytes_per_second\": %.0f, "
+               "\"peak_rss_kb\": %ld}\n",
+               shape, statements, seed, size, c->token_count, c->node_count, lex_seconds, parse_seconds,
+               generate_seconds, c->token_count / lex_seconds, c->node_count / parse_seconds, size / total,
+               usage.ru_maxrss);
+    }
+    freeCompiler(c);
+    fclose(sink);
+    free(source);
+    return failed;
+}
+
+// Lex a generated program on 1 to 'max_threads' threads and check every
+// token stream against the sequential lexer's
+int benchmarkLexing(const char *shape, long statements, unsigned long long seed, int max_threads)
+{
+    char *source = NULL;
+    size_t size = 0;
+    FILE *generated = open_memstream(&source, &size);
+    writeSynthetic(generated, shape, statements, seed);
+    fclose(generated);
+
+    Compiler *reference = newCompiler(NULL);
+    double start = now();
+    int failed = lexSource(reference, source);
+    double base = now() - start;
+    printf("%ld %s statements, %zu bytes, %d tokens\n", statements, shape, size, reference->token_count);
+    printf("threads  chunks  seconds  tokens/s  speedup  identical\n");
+    printf("%7s  %6d  %7.3f  %8.0f  %7.2f  %9s\n", "seq", 1, base, reference->token_count / base, 1.0, "-");
+
+    for (int threads = 1; threads <= max_threads && !failed; threads++)
+    {
+        Compiler *c = newCompiler(NULL);
+        int chunks = (int)(size / LEX_CHUNK_MIN) < threads ? (int)(size / LEX_CHUNK_MIN) : threads;
+        c->lex_threads = threads;
+        start = now();
+        failed = lexSource(c, source);
+        double seconds = now() - start;
+        int identical = !failed && c->token_count == reference->token_count;
+        for (int i = 0; identical && i < c->token_count; i++)
+        {
+            identical = c->tokens[i].type == reference->tokens[i].type &&
+                        c->tokens[i].line == reference->tokens[i].line &&
+                        strcmp(c->tokens[i].text, reference->tokens[i].text) == 0;
+        }
+        printf("%7d  %6d  %7.3f  %8.0f  %7.2f  %9s\n", threads, chunks > 1 ? chunks : 1, seconds,
+               c->token_count / seconds, base / seconds, identical ? "yes" : "NO");
+        if (!identical)
+            failed = 1;
+        freeCompiler(c);
+    }
+    if (reference->error[0])
+        fprintf(stderr, "%s\n", reference->error);
+    freeCompiler(reference);
+    free(source);
+    return failed;
+}
+
+// Add the names listed one per line in 'path' to 'files'
+int readFileList(const char *path, const char ***files, int *count, int *capacity)
+{
+    char line[4096];
+    FILE *list = fopen(path, "r");
+    if (!list)
+        return 0;
+    while (fgets(line, sizeof(line), list))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0')
+            continue;
+        if (*count == *capacity)
+        {
+            *capacity = *capacity ? *capacity * 2 : 64;
+            *files = realloc(*files, *capacity * sizeof(char *));
+        }
+        (*files)[(*count)++] = strdup(line);
+    }
+    fclose(list);
+    return 1;
+}
+
+// Free the input names. Those from the command line are copied as well,
+// so every one is owned by the list.
+void freeFileList(const char **files, int count)
+{
+    for (int i = 0; i < count; i++)
+        free((char *)files[i]);
+    free(files);
+}
+
+void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [-time-passes] [-stats] [-json]   compile the built-in sample to stdout\n"
+            "       %s [-j N] [-scaling] [-int N] [-list FILE] [-asm CMD] [-cache DIR] [-cache-size N] [-time-passes] [-stats] [-json] FILE...\n"
+            "       %s -generate SHAPE N [-seed S]      write a program of N statements to stdout\n"
+            "       %s -bench SHAPE N [-seed S] [-lex-threads N]  time each stage on it, one JSON line\n"
+            "       %s -bench SHAPE N -scaling [-j N]    lex it on 1 to N threads, check and compare\n"
+            "  -j N          compile on N threads (default: one per core)\n"
+            "  -list FILE    also compile the files listed in FILE, one per line\n"
+            "  -scaling      compile the batch on 1 to N threads and report the speedup\n"
+            "                (without the cache)\n"
+            "  -int N        make int 8, 16 or 32 bits wide (default 8)\n"
+            "  -asm CMD      also write a .list memory image with CMD (path to asm.py)\n"
+            "  -cache DIR    reuse outputs of programs compiled before, kept in DIR\n"
+            "  -cache-size N keep the cache under N bytes, K, M or G suffix (default 64M)\n"
+            "  -time-passes  report the time spent lexing, parsing and generating code\n"
+            "  -stats        report token and node counts, memory, recursion depth and\n"
+            "                instructions emitted by kind\n"
+            "  -json         print those reports as JSON\n"
+            "  -lex-threads N lex inputs over 128K in chunks on N threads\n"
+            "  SHAPE         flat, nested, expr or ident\n",
+            program, program, program, program, program);
+}
+
+int main(int argc, char *argv[])
+{
+    const char **files = NULL;
+    int file_count = 0, file_capacity = 0;
+    int thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int scaling = 0;
+    const char *assembler = NULL;
+    const char *bench_mode = NULL, *bench_shape = NULL;
+    long bench_statements = 0;
+    unsigned long long seed = 1;
+    int time_passes = 0, counts = 0, json = 0;
+    int lex_threads = 1;
+    int int_bytes = 1;
+    Stats totals, *stats = NULL;
+    Cache cache;
+
+    memset(&cache, 0, sizeof(cache));
+    cache.max_bytes = 64LL << 20;
+    pthread_mutex_init(&cache.lock, NULL);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            thread_count = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-scaling") == 0)
+        {
+            scaling = 1;
+        }
+        else if (strcmp(argv[i], "-int") == 0 && i + 1 < argc)
+        {
+            int bits = atoi(argv[++i]);
+            if (bits != 8 && bits != 16 && bits != 32)
+            {
+                fprintf(stderr, "-int takes 8, 16 or 32\n");
+                return 1;
+            }
+            int_bytes = bits / 8;
+        }
+        else if (strcmp(argv[i], "-list") == 0 && i + 1 < argc)
+        {
+            if (!readFileList(argv[++i], &files, &file_count, &file_capacity))
+            {
+                perror(argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-asm") == 0 && i + 1 < argc)
+        {
+            assembler = argv[++i];
+        }
+        else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc)
+        {
+            cache.dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "-cache-size") == 0 && i + 1 < argc)
+        {
+            char *suffix;
+            cache.max_bytes = strtoll(argv[++i], &suffix, 10);
+            if (*suffix == 'K' || *suffix == 'k')
+                cache.max_bytes <<= 10;
+            else if (*suffix == 'M' || *suffix == 'm')
+                cache.max_bytes <<= 20;
+            else if (*suffix == 'G' || *suffix == 'g')
+                cache.max_bytes <<= 30;
+        }
+        else if ((strcmp(argv[i], "-generate") == 0 || strcmp(argv[i], "-bench") == 0) && i + 2 < argc)
+        {
+            bench_mode = argv[i];
+            bench_shape = argv[++i];
+            bench_statements = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-lex-threads") == 0 && i + 1 < argc)
+        {
+            lex_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-time-passes") == 0)
+        {
+            time_passes = 1;
+        }
+        else if (strcmp(argv[i], "-stats") == 0)
+        {
+            counts = 1;
+        }
+        else if (strcmp(argv[i], "-json") == 0)
+        {
+            json = 1;
+        }
+        else if (argv[i][0] == '-')
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            if (file_count == file_capacity)
+            {
+                file_capacity = file_capacity ? file_capacity * 2 : 64;
+                files = realloc(files, file_capacity * sizeof(char *));
+            }
+            files[file_count++] = strdup(argv[i]);
+        }
+    }
+    if (thread_count < 1)
+        thread_count = 1;
+    if (thread_count > MAX_THREADS)
+        thread_count = MAX_THREADS;
+    if (lex_threads < 1)
+        lex_threads = 1;
+    if (lex_threads > MAX_THREADS)
+        lex_threads = MAX_THREADS;
+
+    if (bench_mode)
+    {
+        if (!isBenchShape(bench_shape) || bench_statements < 0)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        freeFileList(files, file_count);
+        if (strcmp(bench_mode, "-generate") == 0)
+        {
+            writeSynthetic(stdout, bench_shape, bench_statements, seed);
+            return 0;
+        }
+        if (scaling)
+            return benchmarkLexing(bench_shape, bench_statements, seed, thread_count);
+        return benchmark(bench_shape, bench_statements, seed, lex_threads);
+    }
+
+    // Nothing is counted, or timed, unless a report was asked for
+    memset(&totals, 0, sizeof(totals));
+    pthread_mutex_init(&totals.lock, NULL);
+    if (time_passes || counts)
+        stats = &totals;
+
+    if (file_count == 0)
+    {
+        const char *inputProgram =
+            "int a;\n"
+            "int b;\n"
+            "a = 10;\n"
+            "if (a == 10) { a = 20; }\n"
+            "while (a > 15) { a = a - 1; b = b + 2; }\n";
+        testCompiler(inputProgram, stats);
+        if (stats)
+            printStats(stderr, stats, time_passes, counts, json);
+        freeFileList(files, file_count);
+        return 0;
+    }
+    // The output depends on the compiler, the width of int, and on the
+    // assembler when there is one: a different asm.py, or a changed one,
+    // must not hit
+    snprintf(cache.options, sizeof(cache.options), "%s", COMPILER_VERSION);
+    if (assembler)
+    {
+        struct stat info;
+        memset(&info, 0, sizeof(info));
+        stat(assembler, &info);
+        snprintf(cache.options, sizeof(cache.options), "%s list %s %lld %lld", COMPILER_VERSION, assembler,
+                 (long long)info.st_size, (long long)info.st_mtime);
+    }
+    if (int_bytes > 1)
+    {
+        size_t used = strlen(cache.options);
+        snprintf(cache.options + used, sizeof(cache.options) - used, " int %d", int_bytes * 8);
+    }
+    // Every run after the first would be all cache hits, which times the
+    // cache instead of the threads
+    if (scaling && cache.dir)
+    {
+        fprintf(stderr, "-scaling compiles without the cache\n");
+        cache.dir = NULL;
+    }
+    if (cache.dir)
+    {
+        mkdir(cache.dir, 0777);
+        cacheEvict(&cache);
+    }
+
+    int failed = 0;
+    if (!scaling)
+    {
+        failed = compileBatch(files, file_count, thread_count, &cache, assembler, stats, lex_threads, int_bytes);
+    }
+    else
+    {
+        // Same batch on 1 to N threads. Speedup is against the 1 thread run.
+        double base = 0;
+        printf("threads  seconds  files/s  speedup\n");
+        for (int threads = 1; threads <= thread_count; threads++)
+        {
+            double start = now();
+            failed = compileBatch(files, file_count, threads, &cache, assembler, stats, lex_threads, int_bytes);
+            double seconds = now() - start;
+            if (threads == 1)
+                base = seconds;
+            printf("%7d  %7.3f  %7.0f  %7.2f\n", threads, seconds, file_count / seconds, base / seconds);
+        }
+    }
+
+    if (cache.dir)
+    {
+        cacheEvict(&cache);
+        fprintf(stderr, "cache: %d hits (%d unchanged, %d same tokens), %d misses, %d evicted, %lld bytes\n",
+                cache.source_hits + cache.token_hits, cache.source_hits, cache.token_hits, cache.misses,
+                cache.evicted, cache.bytes);
+    }
+    if (stats)
+        printStats(stderr, stats, time_passes, counts, json);
+    pthread_mutex_destroy(&totals.lock);
+    pthread_mutex_destroy(&cache.lock);
+    freeFileList(files, file_count);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Run the front end benchmark for every shape and size, each in a fresh
+# process so peak RSS belongs to that run alone, and append the results
+# to a JSON lines file for comparison with earlier runs.
+#
+#   ./bench.sh [OUTPUT]          default bench.jsonl
+#
+# COMPILER, SHAPES, SIZES, EXPR_MAX and SEED override the defaults below.
+# Peak RSS is about 500 bytes per statement of the flat shape, 800 of
+# nested and ident, and 8.5 KB of expr, which has 80 tokens a statement.
+# So 10M statements take up to 8 GB, and expr stops at EXPR_MAX.
+
+COMPILER=${COMPILER:-./IntegratedComplilerProgram}
+SHAPES=${SHAPES:-"flat nested expr ident"}
+SIZES=${SIZES:-"1000 10000 100000 1000000 10000000"}
+EXPR_MAX=${EXPR_MAX:-1000000}
+SEED=${SEED:-1}
+OUTPUT=${1:-bench.jsonl}
+
+status=0
+for shape in $SHAPES; do
+    for size in $SIZES; do
+        [ "$shape" = expr ] && [ "$size" -gt "$EXPR_MAX" ] && continue
+        if ! "$COMPILER" -bench "$shape" "$size" -seed "$SEED" >> "$OUTPUT"; then
+            echo "bench.sh: $shape $size failed" >&2
+            status=1
+        fi
+    done
+done
+exit $status
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Check that -scaling times the compiler and not the cache: a batch run
+# with -cache must leave the cache alone, and no thread count may be more
+# than that many times faster than one thread.
+#
+#   ./scaling.sh
+#
+# COMPILER, FILES, STATEMENTS and THREADS override the defaults below.
+
+COMPILER=${COMPILER:-./IntegratedComplilerProgram}
+FILES=${FILES:-15}
+STATEMENTS=${STATEMENTS:-2000}
+THREADS=${THREADS:-4}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+i=1
+while [ "$i" -le "$FILES" ]; do
+    "$COMPILER" -generate flat "$STATEMENTS" -seed "$i" > "$work/p$i.sl" || exit 1
+    i=$((i + 1))
+done
+
+"$COMPILER" -scaling -j "$THREADS" -cache "$work/cache" "$work"/p*.sl > "$work/scaling" || exit 1
+cat "$work/scaling"
+
+status=0
+if [ -e "$work/cache" ]; then
+    echo "scaling.sh: -scaling wrote to the cache" >&2
+    status=1
+fi
+# One and a half times the thread count leaves room for timing noise
+if ! awk 'NR > 1 && $4 > 1.5 * $1 { print "scaling.sh: " $1 " threads are " $4 " times faster"; bad = 1 }
+          END { exit bad }' "$work/scaling" >&2; then
+    status=1
+fi
+exit $status